@@ -0,0 +1,151 @@
+#pragma once
+#include "indexfactory.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+/*
+TuningOptions es la grilla y el método de tune_index():
+
+- capacities: capacidades máximas a probar; solo sirven las que están
+en index_capacities, porque el resultado tiene que poder crearse con
+make_record_index().
+- reinsert_fractions: valores de reinsert_fraction a probar.
+- sample: cantidad de registros tomados al azar (con `seed`) para
+construir los árboles; 0 usa todos.
+- repeats: veces que se construye y se reproduce la carga por
+configuración; cuenta el mejor tiempo, que es el menos afectado por
+el ruido de la máquina.
+*/
+struct TuningOptions
+{
+    vector<size_t> capacities{index_capacities.begin(), index_capacities.end()};
+    vector<double> reinsert_fractions{0, 0.15, 0.3, 0.45};
+    size_t sample{0};
+    unsigned seed{49};
+    size_t repeats{3};
+};
+
+// Medidas de una configuración de la grilla.
+struct TuningResult
+{
+    IndexSpec spec;
+    double build_ms{numeric_limits<double>::infinity()};
+    double replay_ms{numeric_limits<double>::infinity()};
+    size_t errors{0}; //<commands of the workload answered with err
+    IndexStats stats;
+};
+
+/*
+tune_index() busca la capacidad de nodo y la fracción de reinserción
+más rápidas para una carga de consultas registrada. La carga es texto
+con órdenes del protocolo de QueryServer (server.h), una por línea,
+sobre las columnas de `base`; se puede grabar del lado del cliente,
+por ejemplo con `tee carga.txt | mainProgram --serve`.
+
+Para cada combinación de la grilla construye con make_record_index()
+un índice sobre la muestra de `records`, con el resto de `base` sin
+cambios, y mide la construcción y la reproducción de la carga con
+RecordIndex::serve(). Las inserciones de la carga usan `new_record`
+como registro base. Cada repetición parte de un índice nuevo, así las
+inserciones y eliminaciones de la carga no se acumulan.
+
+Devuelve los resultados del más rápido al más lento en la
+reproducción; el primero es la configuración recomendada.
+*/
+template <typename Record>
+vector<TuningResult> tune_index(const vector<Record> &records, const vector<double Record::*> &fields,
+                                const IndexSpec &base, const string &workload,
+                                const TuningOptions &options, function<Record()> new_record)
+{
+    if (records.empty() || workload.empty() || options.capacities.empty() ||
+        options.reinsert_fractions.empty())
+    {
+        throw invalid_argument("tune_index: empty records, workload or grid");
+    }
+    vector<Record> sample = records;
+    if (options.sample > 0 && options.sample < sample.size())
+    {
+        shuffle(sample.begin(), sample.end(), mt19937(options.seed));
+        sample.resize(options.sample);
+    }
+    using clock = chrono::steady_clock;
+    auto ms_since = [](clock::time_point start)
+    {
+        return chrono::duration<double, milli>(clock::now() - start).count();
+    };
+    vector<TuningResult> results;
+    for (size_t capacity : options.capacities)
+    {
+        for (double fraction : options.reinsert_fractions)
+        {
+            TuningResult result;
+            result.spec = base;
+            result.spec.max_children = capacity;
+            result.spec.reinsert_fraction = fraction;
+            for (size_t repeat = 0; repeat < max<size_t>(options.repeats, 1); repeat++)
+            {
+                auto start = clock::now();
+                auto index = make_record_index<Record>(result.spec, fields);
+                index->build(sample);
+                result.build_ms = min(result.build_ms, ms_since(start));
+                istringstream in(workload);
+                ostringstream out;
+                start = clock::now();
+                index->serve(in, out, new_record);
+                result.replay_ms = min(result.replay_ms, ms_since(start));
+                if (repeat == 0)
+                {
+                    result.stats = index->stats();
+                    string responses = out.str();
+                    for (size_t at = 0; (at = responses.find("err ", at)) != string::npos; at += 4)
+                    {
+                        result.errors += at == 0 || responses[at - 1] == '\n';
+                    }
+                }
+            }
+            results.push_back(result);
+        }
+    }
+    stable_sort(results.begin(), results.end(), [](const TuningResult &lhs, const TuningResult &rhs)
+                { return lhs.replay_ms < rhs.replay_ms; });
+    return results;
+}
+
+/*
+print_tuning() escribe los resultados como tabla, precedida por los
+tamaños de caché de la máquina cuando el sistema los informa (en
+Linux, sysconf()), para comparar con el tamaño de los nodos.
+*/
+inline void print_tuning(const vector<TuningResult> &results, ostream &out)
+{
+#if defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE)
+    out << "L1d=" << sysconf(_SC_LEVEL1_DCACHE_SIZE) << " L2=" << sysconf(_SC_LEVEL2_CACHE_SIZE)
+        << " line=" << sysconf(_SC_LEVEL1_DCACHE_LINESIZE) << " bytes\n";
+#endif
+    out << "capacity reinsert node_bytes height nodes  build_ms replay_ms errors\n";
+    for (const TuningResult &result : results)
+    {
+        out << setw(8) << result.spec.max_children << setw(9) << result.spec.reinsert_fraction
+            << setw(11) << result.stats.node_bytes << setw(7) << result.stats.height << setw(6)
+            << result.stats.nodes << fixed << setprecision(2) << setw(10) << result.build_ms
+            << setw(10) << result.replay_ms << defaultfloat << setprecision(6) << setw(7)
+            << result.errors << '\n';
+    }
+}
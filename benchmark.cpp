@@ -0,0 +1,1398 @@
+#include "rstartree.h"
+#include "normalizer.h"
+#include "profile.h"
+#include "ingest.h"
+#include "csvloader.h"
+#include "paciente.h"
+#include "columnstore.h"
+#include "wal.h"
+#include "export.h"
+#include "indexfactory.h"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+Programa de pruebas de rendimiento del árbol R*.
+
+Uso: benchmark [nombre] [hilos]
+
+Sin argumentos ejecuta todas las pruebas; con un nombre ejecuta solo
+esa prueba. `hilos` es el máximo de hilos de las pruebas paralelas
+(por defecto, los núcleos de la máquina). Se compila con -pthread. Los tiempos se imprimen con LOG_DURATION (profile.h) en
+la salida de error y las métricas en la salida estándar.
+
+Las pruebas cuyo nombre empieza con "check" no miden tiempos:
+comparan una función del árbol con un cálculo de referencia e
+imprimen la cantidad de diferencias; si alguna encuentra diferencias
+el programa termina con código 1.
+*/
+
+size_t comprobacionesFallidas = 0; //<checks that found mismatches
+
+void informarComprobacion(const string &label, size_t mismatches)
+{
+    cout << label << ": mismatches=" << mismatches << endl;
+    comprobacionesFallidas += mismatches > 0;
+}
+
+// Lee un archivo de puntos "x,y,z,..." como Files/20000.csv; con
+// `cabecera` se descarta la primera línea (nombres de columnas).
+vector<vector<double>> leerPuntos(const string &path, bool cabecera = false)
+{
+    vector<vector<double>> points;
+    ifstream file(path);
+    string line;
+    if (cabecera)
+    {
+        getline(file, line);
+    }
+    while (getline(file, line))
+    {
+        stringstream ss(line);
+        string token;
+        vector<double> point;
+        while (getline(ss, token, ','))
+        {
+            point.push_back(stod(token));
+        }
+        if (!point.empty())
+        {
+            points.push_back(point);
+        }
+    }
+    return points;
+}
+
+// Caja de lado 1 alrededor de un punto, igual que createBox3D en mainProgram.cpp.
+template <size_t dimensions, typename cost_type>
+RStarBoundingBox<dimensions, cost_type> cajaDePunto(const vector<double> &point)
+{
+    RStarBoundingBox<dimensions, cost_type> box;
+    for (size_t axis = 0; axis < dimensions; axis++)
+    {
+        box.min_edges[axis] = point[axis];
+        box.max_edges[axis] = point[axis] + 1;
+    }
+    return box;
+}
+
+// Ventanas de consulta aleatorias de lado `side`, reproducibles por la semilla.
+vector<vector<double>> ventanasAleatorias(const vector<vector<double>> &points,
+                                          size_t count, double side)
+{
+    mt19937 gen(2023);
+    uniform_int_distribution<size_t> pick(0, points.size() - 1);
+    vector<vector<double>> windows;
+    for (size_t i = 0; i < count; i++)
+    {
+        vector<double> window = points[pick(gen)];
+        for (double &v : window)
+        {
+            v -= side / 2;
+        }
+        windows.push_back(window);
+    }
+    return windows;
+}
+
+/*
+calidadDelArbol construye el árbol sobre Files/20000.csv con la
+aritmética de costo indicada y reporta altura, número de nodos,
+solapamiento total y cobertura, además del tiempo de construcción
+y de 1000 consultas. Con cost_type = int se reproduce el cálculo
+anterior, que desborda 32 bits en el área de los nodos grandes.
+*/
+template <typename cost_type>
+void calidadDelArbol(const string &label, const vector<vector<double>> &points)
+{
+    using Tree = RStarTree<size_t, 3, 10, 20, cost_type>;
+    using Box = RStarBoundingBox<3, cost_type>;
+    Tree tree;
+    {
+        LOG_DURATION("build " + label);
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            tree.insert(i, cajaDePunto<3, cost_type>(points[i]));
+        }
+    }
+    auto stats = tree.stats();
+    cout << label << ": height=" << stats.height << " nodes=" << stats.nodes
+         << " leaf_nodes=" << stats.leaf_nodes << " leaves=" << stats.leaves
+         << " total_overlap=" << stats.total_overlap
+         << " coverage=" << stats.coverage << endl;
+
+    size_t found = 0;
+    auto windows = ventanasAleatorias(points, 1000, 1000);
+    {
+        LOG_DURATION("1000 queries " + label);
+        for (auto &corner : windows)
+        {
+            Box window;
+            for (size_t axis = 0; axis < 3; axis++)
+            {
+                window.min_edges[axis] = corner[axis];
+                window.max_edges[axis] = corner[axis] + 1000;
+            }
+            found += tree.find_objects_in_area(window).size();
+        }
+    }
+    cout << label << ": results=" << found << endl;
+}
+
+void benchmarkCalidad()
+{
+    auto points = leerPuntos("./Files/20000.csv");
+    calidadDelArbol<int>("int (legacy)", points);
+    calidadDelArbol<int64_t>("int64_t", points);
+    calidadDelArbol<double>("double", points);
+}
+
+/*
+benchmarkDuplicados indexa el archivo covid con las mismas cajas que
+mainProgram.cpp (createBox3D con a, b, c truncados a int y lado 1),
+con y sin agrupación de cajas repetidas en una sola hoja.
+*/
+void benchmarkDuplicados()
+{
+    auto points = leerPuntos("./Files/covid_DB_datos_importantes_completos_double.csv", true);
+    for (bool bucket : {false, true})
+    {
+        RStarTree<size_t, 3, 10, 20> tree;
+        tree.bucket_duplicates = bucket;
+        string label = bucket ? "bucketed" : "one leaf per value";
+        {
+            LOG_DURATION("build " + label);
+            for (size_t i = 0; i < points.size(); i++)
+            {
+                vector<double> cell = {double(int(points[i][0])), double(int(points[i][1])),
+                                       double(int(points[i][2]))};
+                tree.insert(i, cajaDePunto<3, double>(cell));
+            }
+        }
+        auto stats = tree.stats();
+        cout << label << ": height=" << stats.height << " nodes=" << stats.nodes
+             << " leaves=" << stats.leaves << " values=" << stats.values
+             << " total_overlap=" << stats.total_overlap << endl;
+    }
+}
+
+/*
+benchmarkAltaDimension indexa las 11 características del archivo
+covid (normalizadas con z-score) y compara el R*-tree con un
+recorrido lineal de todas las cajas, con las mismas ventanas de
+consulta de semiancho 0.75 alrededor de pacientes reales.
+*/
+void benchmarkAltaDimension()
+{
+    const size_t D = 11;
+    using Tree = RStarTree<size_t, D, 10, 20>;
+    using Box = RStarBoundingBox<D>;
+    auto rows = leerPuntos("./Files/covid_DB_datos_importantes_completos_double.csv", true);
+    FeatureNormalizer<D> normalizer;
+    vector<array<double, D>> features(rows.size());
+    for (size_t r = 0; r < rows.size(); r++)
+    {
+        copy(rows[r].begin(), rows[r].begin() + D, features[r].begin());
+        normalizer.observe(features[r]);
+    }
+    vector<Box> boxes;
+    for (auto &f : features)
+    {
+        boxes.push_back(normalizer.point_box(f));
+    }
+    mt19937 gen(11);
+    uniform_int_distribution<size_t> pick(0, boxes.size() - 1);
+    vector<Box> windows(20000);
+    for (Box &window : windows)
+    {
+        const Box &center = boxes[pick(gen)];
+        for (size_t axis = 0; axis < D; axis++)
+        {
+            window.min_edges[axis] = center.min_edges[axis] - 0.75;
+            window.max_edges[axis] = center.max_edges[axis] + 0.75;
+        }
+    }
+
+    Tree tree;
+    for (size_t i = 0; i < boxes.size(); i++)
+    {
+        tree.insert(i, boxes[i]);
+    }
+    auto stats = tree.stats();
+    cout << "R*-tree: height=" << stats.height << " nodes=" << stats.nodes << endl;
+    size_t indexed = 0;
+    {
+        LOG_DURATION("20000 11-D queries R*-tree");
+        for (const Box &window : windows)
+        {
+            indexed += tree.find_objects_intersecting(window).size();
+        }
+    }
+    cout << "R*-tree: results=" << indexed << endl;
+
+    size_t found = 0;
+    {
+        LOG_DURATION("20000 11-D queries linear scan");
+        for (const Box &window : windows)
+        {
+            for (const Box &box : boxes)
+            {
+                found += window.intersects(box);
+            }
+        }
+    }
+    cout << "linear scan: results=" << found << endl;
+}
+
+/*
+benchmarkPuntos indexa Files/20000.csv dos veces, una con hojas que
+guardan una caja degenerada por punto y otra con hojas puntuales
+(point_leaves), y compara la memoria de las hojas y el tiempo de
+construcción y de 1000 consultas de ventana.
+*/
+template <bool point_leaves>
+void arbolDePuntos(const string &label, const vector<vector<double>> &points)
+{
+    using Tree = RStarTree<size_t, 3, 10, 20, double, point_leaves>;
+    using Box = RStarBoundingBox<3>;
+    Tree tree;
+    {
+        LOG_DURATION("build " + label);
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            Box box;
+            RStarPoint<3> point;
+            for (size_t axis = 0; axis < 3; axis++)
+            {
+                box.min_edges[axis] = box.max_edges[axis] = points[i][axis];
+                point.coords[axis] = points[i][axis];
+            }
+            if constexpr (point_leaves)
+                tree.insert(i, point);
+            else
+                tree.insert(i, box);
+        }
+    }
+    auto stats = tree.stats();
+    cout << label << ": height=" << stats.height << " nodes=" << stats.nodes
+         << " leaf_bytes=" << stats.leaf_bytes << endl;
+
+    size_t found = 0;
+    auto windows = ventanasAleatorias(points, 1000, 1000);
+    {
+        LOG_DURATION("1000 queries " + label);
+        for (auto &corner : windows)
+        {
+            Box window;
+            for (size_t axis = 0; axis < 3; axis++)
+            {
+                window.min_edges[axis] = corner[axis];
+                window.max_edges[axis] = corner[axis] + 1000;
+            }
+            found += tree.find_objects_intersecting(window).size();
+        }
+    }
+    cout << label << ": results=" << found << endl;
+}
+
+void benchmarkPuntos()
+{
+    auto points = leerPuntos("./Files/20000.csv");
+    arbolDePuntos<false>("box leaves", points);
+    arbolDePuntos<true>("point leaves", points);
+}
+
+/*
+benchmarkRelayout construye el árbol sobre Files/20000.csv y mide
+10000 ventanas de consulta antes y después de relayout(), que copia
+los nodos y las hojas a memoria contigua en preorden.
+*/
+void benchmarkRelayout()
+{
+    auto points = leerPuntos("./Files/20000.csv");
+    RStarTree<size_t, 3, 10, 20> tree;
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        tree.insert(i, cajaDePunto<3, double>(points[i]));
+    }
+    auto windows = ventanasAleatorias(points, 10000, 1000);
+    for (bool compact : {false, true})
+    {
+        string label = compact ? "after relayout" : "allocation order";
+        if (compact)
+        {
+            LOG_DURATION("relayout");
+            tree.relayout();
+        }
+        size_t found = 0;
+        {
+            LOG_DURATION("10000 queries " + label);
+            for (auto &corner : windows)
+            {
+                RStarBoundingBox<3> window;
+                for (size_t axis = 0; axis < 3; axis++)
+                {
+                    window.min_edges[axis] = corner[axis];
+                    window.max_edges[axis] = corner[axis] + 1000;
+                }
+                found += tree.find_objects_in_area(window).size();
+            }
+        }
+        cout << label << ": results=" << found << endl;
+    }
+}
+
+/*
+construccionMasiva mide bulk_load() sobre los mismos registros en
+serie (un hilo, el valor por defecto) y en paralelo con 2, ...,
+max_threads hilos (al menos 2), y reporta el tiempo (la mejor de tres
+corridas) y la aceleración respecto de la versión en serie, además
+del tiempo de insertar los registros uno por uno como referencia.
+*/
+template <typename Tree>
+void construccionMasiva(const string &label,
+                        const vector<pair<size_t, typename Tree::LeafGeometry>> &records,
+                        unsigned max_threads)
+{
+    {
+        Tree tree;
+        LOG_DURATION(label + ": insert one by one");
+        for (auto &record : records)
+        {
+            tree.insert(record.first, record.second);
+        }
+    }
+    double single = 0;
+    for (unsigned threads = 1; threads <= max(max_threads, 2u); threads++)
+    {
+        double best = 0;
+        for (int run = 0; run < 3; run++)
+        {
+            Tree tree;
+            auto start = chrono::steady_clock::now();
+            tree.bulk_load(records, threads);
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            best = run == 0 ? ms : min(best, ms);
+        }
+        single = threads == 1 ? best : single;
+        cout << label << ": bulk_load " << (threads == 1 ? "serial" : "parallel") << " threads=" << threads
+             << " time=" << best << " ms speedup=" << single / best << endl;
+    }
+}
+
+void benchmarkConstruccionMasiva(unsigned max_threads)
+{
+    auto points = leerPuntos("./Files/20000.csv");
+    vector<pair<size_t, RStarBoundingBox<3>>> boxes;
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        boxes.push_back({i, cajaDePunto<3, double>(points[i])});
+    }
+    construccionMasiva<RStarTree<size_t, 3, 10, 20>>("20000.csv", boxes, max_threads);
+
+    const size_t D = 11;
+    auto rows = leerPuntos("./Files/covid_DB_datos_importantes_completos_double.csv", true);
+    FeatureNormalizer<D> normalizer;
+    vector<array<double, D>> features(rows.size());
+    for (size_t r = 0; r < rows.size(); r++)
+    {
+        copy(rows[r].begin(), rows[r].begin() + D, features[r].begin());
+        normalizer.observe(features[r]);
+    }
+    vector<pair<size_t, RStarPoint<D>>> patients;
+    for (size_t i = 0; i < features.size(); i++)
+    {
+        patients.push_back({i, normalizer.point(features[i])});
+    }
+    construccionMasiva<RStarTree<size_t, D, 10, 20, double, true>>("covid", patients, max_threads);
+}
+
+/*
+benchmarkConsultaParalela mide en Files/20000.csv 200 ventanas amplias
+(lado 8000) y 10000 ventanas chicas (lado 1000) en serie (sin grupo de
+hilos, el valor por defecto) y repartidas entre 2, ..., max_threads
+hilos (al menos 2, set_query_threads()). Reporta la aceleración
+respecto de la versión en serie (la mejor de tres corridas) y compara
+la cantidad de resultados de cada ventana con la de la versión en
+serie. Las ventanas chicas no llegan al umbral de frontera y deben
+mantener el tiempo del recorrido secuencial.
+*/
+void benchmarkConsultaParalela(unsigned max_threads)
+{
+    auto points = leerPuntos("./Files/20000.csv");
+    RStarTree<size_t, 3, 10, 20> tree;
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        tree.insert(i, cajaDePunto<3, double>(points[i]));
+    }
+    size_t mismatches = 0;
+    for (double side : {8000.0, 1000.0})
+    {
+        vector<RStarBoundingBox<3>> windows;
+        for (auto &corner : ventanasAleatorias(points, side > 1000 ? 200 : 10000, side))
+        {
+            RStarBoundingBox<3> window;
+            for (size_t axis = 0; axis < 3; axis++)
+            {
+                window.min_edges[axis] = corner[axis];
+                window.max_edges[axis] = corner[axis] + side;
+            }
+            windows.push_back(window);
+        }
+        vector<size_t> serial;
+        double single = 0;
+        for (unsigned threads = 1; threads <= max(max_threads, 2u); threads++)
+        {
+            tree.set_query_threads(threads);
+            vector<size_t> found(windows.size());
+            double best = 0;
+            for (int run = 0; run < 3; run++)
+            {
+                auto start = chrono::steady_clock::now();
+                for (size_t i = 0; i < windows.size(); i++)
+                {
+                    found[i] = tree.find_objects_in_area(windows[i]).size();
+                }
+                double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                best = run == 0 ? ms : min(best, ms);
+            }
+            if (threads == 1)
+            {
+                serial = found;
+                single = best;
+            }
+            mismatches += found != serial;
+            cout << "side " << side << " " << (threads == 1 ? "serial" : "parallel") << " threads=" << threads
+                 << " time=" << best << " ms speedup=" << single / best << endl;
+        }
+    }
+    tree.set_query_threads(1);
+    informarComprobacion("check parallel query results", mismatches);
+}
+
+/*
+benchmarkIngesta carga Files/20000.csv en el árbol de dos formas: en
+secuencia (leer, parsear e insertar cada línea) y con ingest_file(),
+con 1, 2, ..., max_threads hilos lectores que alimentan al hilo que
+inserta. Para cada corrida se imprimen los contadores de cada etapa:
+si los lectores esperan con la cola llena (producer_stalls) el cuello
+de botella es la inserción; si espera el insertador
+(consumer_stalls), es el parseo.
+*/
+void benchmarkIngesta(unsigned max_threads)
+{
+    const string path = "./Files/20000.csv";
+    auto parsePunto = [](const string &line)
+    {
+        RStarBoundingBox<3> box;
+        stringstream ss(line);
+        string token;
+        for (size_t axis = 0; axis < 3 && getline(ss, token, ','); axis++)
+        {
+            box.min_edges[axis] = stod(token);
+            box.max_edges[axis] = box.min_edges[axis] + 1;
+        }
+        return box;
+    };
+    {
+        RStarTree<size_t, 3, 10, 20> tree;
+        LOG_DURATION("sequential read+parse+insert");
+        ifstream file(path);
+        string line;
+        size_t id = 0;
+        while (getline(file, line))
+        {
+            tree.insert(id++, parsePunto(line));
+        }
+    }
+    for (unsigned parsers = 1; parsers <= max_threads; parsers++)
+    {
+        RStarTree<size_t, 3, 10, 20> tree;
+        size_t id = 0;
+        auto stats = ingest_file<RStarBoundingBox<3>>(path, false, parsers, parsePunto,
+                                                      [&](const vector<RStarBoundingBox<3>> &batch)
+                                                      {
+                                                          for (auto &box : batch)
+                                                          {
+                                                              tree.insert(id++, box);
+                                                          }
+                                                      });
+        cout << "pipeline parsers=" << parsers << ": total=" << stats.total_seconds * 1000
+             << " ms records=" << stats.records << " batches=" << stats.batches
+             << " parse_rate=" << stats.parse_rate() << "/s insert_rate=" << stats.sink_rate()
+             << "/s producer_stalls=" << stats.producer_stalls
+             << " consumer_stalls=" << stats.consumer_stalls << endl;
+    }
+}
+
+/*
+benchmarkCsvCrudo lee Files/covid_DB.csv (111 columnas entre comillas)
+proyectando las 11 columnas de Files/importantColumns.csv, con cada
+política de valores faltantes, e imprime cuántas filas quedaron
+completas, imputadas o descartadas. Como referencia se mide también la
+lectura del archivo ya preprocesado con leerCSVLine().
+*/
+void benchmarkCsvCrudo(unsigned max_threads)
+{
+    auto header = read_csv_names("./Files/dataColumn.csv");
+    auto columns = read_csv_names("./Files/importantColumns.csv");
+    {
+        LOG_DURATION("preprocessed csv, leerCSVLine");
+        ifstream file("./Files/covid_DB_datos_importantes_completos_double.csv");
+        string line;
+        getline(file, line);
+        size_t rows = 0;
+        while (getline(file, line))
+        {
+            rows += leerCSVLine(line).a >= 0;
+        }
+        cout << "preprocessed rows=" << rows << endl;
+    }
+    for (MissingPolicy policy : {MissingPolicy::skip, MissingPolicy::impute})
+    {
+        CsvProjection projection(header, columns, policy);
+        for (unsigned parsers = 1; parsers <= max_threads; parsers++)
+        {
+            size_t counts[3] = {0, 0, 0};
+            auto stats = ingest_file<RowStatus>("./Files/covid_DB.csv", false, parsers,
+                                                [&](const string &line)
+                                                {
+                                                    double values[columnasPaciente];
+                                                    return projection.parse(line, values);
+                                                },
+                                                [&](const vector<RowStatus> &batch)
+                                                {
+                                                    for (RowStatus status : batch)
+                                                        counts[int(status)]++;
+                                                });
+            cout << "raw csv " << (policy == MissingPolicy::skip ? "skip" : "impute")
+                 << " parsers=" << parsers << ": total=" << stats.total_seconds * 1000
+                 << " ms parse_rate=" << stats.parse_rate() << "/s complete=" << counts[0]
+                 << " imputed=" << counts[1] << " skipped=" << counts[2] << endl;
+        }
+    }
+}
+
+/*
+benchmarkColumnar compara dos formas de guardar los pacientes: dentro
+de las hojas (RStarTree<Paciente>) o en un ColumnStore con hojas de 32
+bits. Los 499 pacientes completos se replican con ruido hasta 100000
+filas, se indexan por edad, hematocrito y plaquetas, y cada consulta
+filtra los resultados por leucocitos en [-0.5, 0.5] y promedia la
+proteína C reactiva.
+*/
+void benchmarkColumnar()
+{
+    CsvProjection projection(read_csv_names("./Files/dataColumn.csv"),
+                             read_csv_names("./Files/importantColumns.csv"));
+    vector<Paciente> base;
+    {
+        ifstream file("./Files/covid_DB.csv");
+        string line;
+        double values[columnasPaciente];
+        while (getline(file, line))
+        {
+            if (projection.parse(line, values) == RowStatus::skipped)
+                continue;
+            Paciente paciente;
+            for (size_t c = 0; c < columnasPaciente; c++)
+                paciente.*camposPaciente[c] = values[projection.slot_of(columnasCovid[c])];
+            base.push_back(paciente);
+        }
+    }
+    const size_t rows = 100000;
+    mt19937 rng(7);
+    normal_distribution<double> noise(0, 0.05);
+    vector<Paciente> pacientes(rows);
+    for (size_t r = 0; r < rows; r++)
+    {
+        pacientes[r] = base[r % base.size()];
+        for (size_t c = 1; c < columnasPaciente; c++)
+            pacientes[r].*camposPaciente[c] += noise(rng);
+    }
+    auto indexBox = [](const Paciente &p)
+    {
+        RStarBoundingBox<3> box;
+        double coords[3] = {p.b, p.c, p.d};
+        for (size_t axis = 0; axis < 3; axis++)
+            box.min_edges[axis] = box.max_edges[axis] = coords[axis];
+        return box;
+    };
+    uniform_real_distribution<double> corner(-2, 2), age(0, 19);
+    vector<RStarBoundingBox<3>> windows(2000);
+    for (auto &window : windows)
+    {
+        window.min_edges[0] = age(rng);
+        window.max_edges[0] = window.min_edges[0] + 4;
+        for (size_t axis = 1; axis < 3; axis++)
+        {
+            window.min_edges[axis] = corner(rng);
+            window.max_edges[axis] = window.min_edges[axis] + 1;
+        }
+    }
+
+    RStarTree<Paciente, 3, 10, 20> inlineTree;
+    vector<pair<Paciente, RStarBoundingBox<3>>> inlineRecords;
+    for (const Paciente &p : pacientes)
+        inlineRecords.emplace_back(p, indexBox(p));
+    inlineTree.bulk_load(inlineRecords);
+    double checksum = 0;
+    size_t kept = 0;
+    {
+        LOG_DURATION("2000 queries + filter + mean, Paciente leaves");
+        for (auto &window : windows)
+        {
+            double sum = 0;
+            size_t count = 0;
+            for (auto &leaf : inlineTree.find_objects_intersecting(window))
+            {
+                const Paciente &p = leaf.get_value();
+                if (p.g >= -0.5 && p.g <= 0.5)
+                {
+                    sum += p.k;
+                    count++;
+                }
+            }
+            kept += count;
+            checksum += count > 0 ? sum / count : 0;
+        }
+    }
+    cout << "Paciente leaves: leaf_bytes=" << inlineTree.stats().leaf_bytes << " kept=" << kept
+         << " checksum=" << checksum << endl;
+
+    ColumnStore<columnasPaciente> store;
+    store.reserve(rows);
+    RStarTree<uint32_t, 3, 10, 20> rowTree;
+    vector<pair<uint32_t, RStarBoundingBox<3>>> rowRecords;
+    for (const Paciente &p : pacientes)
+    {
+        ColumnStore<columnasPaciente>::Row values;
+        for (size_t c = 0; c < columnasPaciente; c++)
+            values[c] = p.*camposPaciente[c];
+        rowRecords.emplace_back(store.append(values), indexBox(p));
+    }
+    rowTree.bulk_load(rowRecords);
+    checksum = 0;
+    kept = 0;
+    {
+        LOG_DURATION("2000 queries + filter + mean, row-id leaves + column store");
+        for (auto &window : windows)
+        {
+            auto ids = row_ids(rowTree.find_objects_intersecting(window));
+            store.filter(ids, 6, -0.5, 0.5);
+            auto aggregate = store.aggregate(ids, 10);
+            kept += aggregate.count;
+            checksum += aggregate.mean();
+        }
+    }
+    cout << "row-id leaves: leaf_bytes=" << rowTree.stats().leaf_bytes << " kept=" << kept
+         << " checksum=" << checksum << endl;
+}
+
+/*
+benchmarkWal inserta Files/20000.csv a través de un WriteAheadLog con
+distintos tamaños de grupo (cuántas operaciones comparte cada fsync),
+y luego mide la recuperación: cargar la instantánea escrita con
+checkpoint() y reaplicar un log de 5000 operaciones.
+*/
+void benchmarkWal()
+{
+    using Tree = RStarTree<uint32_t, 3, 10, 20>;
+    auto points = leerPuntos("./Files/20000.csv");
+    const string snapshot = "./wal_benchmark.snapshot", log = "./wal_benchmark.log";
+    for (size_t group : {1, 16, 256})
+    {
+        remove(snapshot.c_str());
+        remove(log.c_str());
+        Tree tree;
+        WriteAheadLog<Tree> wal(tree, snapshot, log, group);
+        wal.open();
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            wal.insert(uint32_t(i), cajaDePunto<3, double>(points[i]));
+        }
+        wal.commit();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "wal group=" << group << ": " << points.size() / seconds << " inserts/s, "
+             << wal.commits << " fsyncs" << endl;
+    }
+    {
+        remove(snapshot.c_str());
+        remove(log.c_str());
+        Tree tree;
+        WriteAheadLog<Tree> wal(tree, snapshot, log);
+        wal.open();
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            wal.insert(uint32_t(i), cajaDePunto<3, double>(points[i]));
+            if (i + 1 == points.size() - 5000)
+                wal.checkpoint();
+        }
+    }
+    {
+        Tree tree;
+        WriteAheadLog<Tree> wal(tree, snapshot, log);
+        {
+            LOG_DURATION("recovery: load snapshot + replay log");
+            wal.open();
+        }
+        cout << "recovered " << tree.size_ << " values, replayed " << wal.replayed << " records" << endl;
+    }
+    remove(snapshot.c_str());
+    remove(log.c_str());
+}
+
+/*
+benchmarkCheckpoint compara, sobre el árbol de Files/20000.csv, el
+costo de guardar el árbol completo con save() contra un checkpoint
+incremental con checkpoint_pages() después de lotes de 10, 100 y 1000
+inserciones.
+*/
+void benchmarkCheckpoint()
+{
+    using Tree = RStarTree<uint32_t, 3, 10, 20>;
+    auto points = leerPuntos("./Files/20000.csv");
+    const string snapshot = "./checkpoint_benchmark.snapshot", pages = "./checkpoint_benchmark.pages";
+    Tree tree;
+    size_t half = points.size() / 2, next = half;
+    for (size_t i = 0; i < half; i++)
+    {
+        tree.insert(uint32_t(i), cajaDePunto<3, double>(points[i]));
+    }
+    {
+        LOG_DURATION("first checkpoint_pages (full)");
+        tree.checkpoint_pages(pages);
+    }
+    for (size_t batch : {10, 100, 1000})
+    {
+        for (size_t end = next + batch; next < end; next++)
+        {
+            tree.insert(uint32_t(next), cajaDePunto<3, double>(points[next]));
+        }
+        auto start = chrono::steady_clock::now();
+        tree.save(snapshot);
+        double full_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        start = chrono::steady_clock::now();
+        uint64_t before = filesystem::file_size(pages);
+        size_t written = tree.checkpoint_pages(pages);
+        double incremental_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << "batch " << batch << ": save=" << full_ms << " ms (" << filesystem::file_size(snapshot)
+             << " bytes), checkpoint_pages=" << incremental_ms << " ms (" << written << " pages, "
+             << filesystem::file_size(pages) - before << " bytes)" << endl;
+    }
+    remove(snapshot.c_str());
+    remove(pages.c_str());
+}
+
+/*
+benchmarkExportacion escribe todas las cajas del árbol de
+Files/20000.csv a un archivo: con ofstream y endl en cada línea (como
+print_tree() antes), con ofstream y '\n', y con export_area() sobre
+un BufferedWriter en CSV y en binario, sin juntar el resultado.
+*/
+void benchmarkExportacion()
+{
+    using Tree = RStarTree<uint32_t, 3, 10, 20>;
+    auto points = leerPuntos("./Files/20000.csv");
+    Tree tree;
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        tree.insert(uint32_t(i), cajaDePunto<3, double>(points[i]));
+    }
+    const string path = "./export_benchmark.out";
+    Tree::Area everything;
+    for (size_t axis = 0; axis < 3; axis++)
+    {
+        everything.min_edges[axis] = -numeric_limits<double>::infinity();
+        everything.max_edges[axis] = numeric_limits<double>::infinity();
+    }
+    for (bool flush_lines : {true, false})
+    {
+        auto start = chrono::steady_clock::now();
+        {
+            ofstream out(path);
+            for (const auto &leaf : tree.find_objects_in_area(everything))
+            {
+                const auto &box = leaf.get_box();
+                out << leaf.get_value();
+                for (size_t axis = 0; axis < 3; axis++)
+                    out << ',' << box.min_edges[axis] << ',' << box.max_edges[axis];
+                if (flush_lines)
+                    out << endl;
+                else
+                    out << '\n';
+            }
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << (flush_lines ? "ofstream+endl" : "ofstream+'\\n'") << ": " << ms << " ms ("
+             << filesystem::file_size(path) << " bytes)\n";
+    }
+    for (export_format format : {export_format::csv, export_format::binary})
+    {
+        auto start = chrono::steady_clock::now();
+        size_t rows, writes;
+        {
+            BufferedWriter out(path);
+            RecordExporter<7> exporter(out, format, {"value", "min_0", "max_0", "min_1", "max_1", "min_2", "max_2"});
+            array<double, 7> row;
+            tree.for_each_in_area(everything, [&](const Tree::LeafWithConstBox &leaf)
+                                  {
+                                      const auto &box = leaf.get_box();
+                                      row[0] = leaf.get_value();
+                                      copy_edges(box, row.data() + 1);
+                                      exporter.write(row); });
+            out.flush();
+            rows = exporter.rows;
+            writes = out.writes;
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << (format == export_format::csv ? "BufferedWriter csv" : "BufferedWriter binary") << ": " << ms
+             << " ms (" << filesystem::file_size(path) << " bytes, " << rows << " rows, " << writes
+             << " writes)" << endl;
+    }
+    remove(path.c_str());
+}
+
+/*
+benchmarkIndiceClave compara, sobre el árbol de Files/20000.csv con
+el índice por clave activo (clave = número de fila), buscar cada valor
+con find_key() contra una búsqueda por área en su caja más un
+recorrido del resultado, y borrar un cuarto de los valores con
+erase_key() contra delete_objects_in_area() sobre una caja interior a
+la suya.
+*/
+void benchmarkIndiceClave()
+{
+    using Tree = RStarTree<uint32_t, 3, 10, 20>;
+    auto points = leerPuntos("./Files/20000.csv");
+    Tree keyed, spatial;
+    keyed.enable_key_index([](uint32_t row)
+                           { return Tree::Handle(row); });
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        keyed.insert(uint32_t(i), cajaDePunto<3, double>(points[i]));
+        spatial.insert(uint32_t(i), cajaDePunto<3, double>(points[i]));
+    }
+    size_t found = 0;
+    {
+        LOG_DURATION("find_key, every value");
+        Tree::LeafWithConstBox leaf(nullptr);
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            found += keyed.find_key(i, leaf) && leaf.get_value() == i;
+        }
+    }
+    cout << "find_key: found=" << found << endl;
+    found = 0;
+    {
+        LOG_DURATION("area search + scan, every value");
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            for (const auto &leaf : spatial.find_objects_in_area(cajaDePunto<3, double>(points[i])))
+            {
+                if (leaf.get_value() == i)
+                {
+                    found++;
+                    break;
+                }
+            }
+        }
+    }
+    cout << "area search: found=" << found << endl;
+    {
+        LOG_DURATION("erase_key, 1/4 of the values");
+        for (size_t i = 0; i < points.size(); i += 4)
+        {
+            keyed.erase_key(i);
+        }
+    }
+    {
+        LOG_DURATION("delete_objects_in_area, 1/4 of the values");
+        for (size_t i = 0; i < points.size(); i += 4)
+        {
+            RStarBoundingBox<3> inside;
+            for (size_t axis = 0; axis < 3; axis++)
+            {
+                inside.min_edges[axis] = points[i][axis] + 0.25;
+                inside.max_edges[axis] = points[i][axis] + 0.75;
+            }
+            spatial.delete_objects_in_area(inside);
+        }
+    }
+    cout << "left after erase_key=" << keyed.size_ << " after delete_objects_in_area=" << spatial.size_
+         << endl;
+}
+
+/*
+benchmarkEsfera busca, sobre las 11 características normalizadas del
+archivo covid (hojas puntuales), los pacientes a distancia 2 o menos
+de 20000 pacientes de referencia: con la caja que rodea la esfera y un
+filtro posterior (como se hacía), con find_objects_within_distance()
+y con la misma búsqueda en orden de distancia.
+*/
+void benchmarkEsfera()
+{
+    const size_t D = 11;
+    using Tree = RStarTree<size_t, D, 10, 20, double, true>;
+    using Box = RStarBoundingBox<D>;
+    auto rows = leerPuntos("./Files/covid_DB_datos_importantes_completos_double.csv", true);
+    FeatureNormalizer<D> normalizer;
+    vector<array<double, D>> features(rows.size());
+    for (size_t r = 0; r < rows.size(); r++)
+    {
+        copy(rows[r].begin(), rows[r].begin() + D, features[r].begin());
+        normalizer.observe(features[r]);
+    }
+    Tree tree;
+    for (size_t i = 0; i < features.size(); i++)
+    {
+        tree.insert(i, normalizer.point(features[i]));
+    }
+    const double radius = 2;
+    mt19937 gen(11);
+    uniform_int_distribution<size_t> pick(0, features.size() - 1);
+    vector<Tree::Point> centers(20000);
+    for (Tree::Point &center : centers)
+    {
+        center = normalizer.point(features[pick(gen)]);
+    }
+    size_t found = 0, fetched = 0;
+    {
+        LOG_DURATION("bounding box + distance filter");
+        for (const Tree::Point &center : centers)
+        {
+            Box box;
+            for (size_t axis = 0; axis < D; axis++)
+            {
+                box.min_edges[axis] = center.coords[axis] - radius;
+                box.max_edges[axis] = center.coords[axis] + radius;
+            }
+            for (const auto &leaf : tree.find_objects_in_area(box))
+            {
+                double sum = 0;
+                for (size_t axis = 0; axis < D; axis++)
+                {
+                    double d = leaf.get_box().coords[axis] - center.coords[axis];
+                    sum += d * d;
+                }
+                found += sum <= radius * radius;
+                fetched++;
+            }
+        }
+    }
+    cout << "bounding box: results=" << found << " fetched=" << fetched << endl;
+    for (bool ordered : {false, true})
+    {
+        found = 0;
+        {
+            LOG_DURATION(ordered ? "find_objects_within_distance, ordered" : "find_objects_within_distance");
+            for (const Tree::Point &center : centers)
+            {
+                found += tree.find_objects_within_distance(center, radius, Tree::unit_weights(), ordered).size();
+            }
+        }
+        cout << (ordered ? "within_distance ordered" : "within_distance") << ": results=" << found << endl;
+    }
+}
+
+/*
+benchmarkFabrica construye con make_record_index() los índices de
+varias combinaciones de columnas del archivo covid y capacidades de
+nodo, elegidas al ejecutar, y mide la construcción y 20000 consultas
+de los 10 vecinos más cercanos. Para la combinación de 11 columnas y
+capacidad 20 repite las consultas con el RStarTree escrito en el
+código, para medir lo que cuesta pasar por la interfaz.
+*/
+void benchmarkFabrica()
+{
+    auto rows = leerPuntos("./Files/covid_DB_datos_importantes_completos_double.csv", true);
+    vector<Paciente> pacientes(rows.size());
+    for (size_t r = 0; r < rows.size(); r++)
+    {
+        for (size_t columna = 0; columna < columnasPaciente; columna++)
+        {
+            pacientes[r].*camposPaciente[columna] = rows[r][columna];
+        }
+        pacientes[r].id = r + 1;
+    }
+    vector<string> names = {"a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k"};
+    vector<double Paciente::*> fields(begin(camposPaciente), end(camposPaciente));
+    mt19937 gen(48);
+    uniform_int_distribution<size_t> pick(0, pacientes.size() - 1);
+    vector<size_t> targets(20000);
+    for (size_t &target : targets)
+    {
+        target = pick(gen);
+    }
+    for (string columns : {"b,c", "a,b,c", "c,d,e,f,g", "a,b,c,d,e,f,g,h,i,j,k"})
+    {
+        for (size_t capacity : index_capacities)
+        {
+            IndexSpec spec = parse_index_spec(columns, to_string(capacity), names);
+            string label = columns + " cap " + to_string(capacity);
+            unique_ptr<RecordIndex<Paciente>> index;
+            {
+                LOG_DURATION("build " + label);
+                index = make_record_index<Paciente>(spec, fields);
+                index->build(pacientes);
+            }
+            size_t found = 0;
+            vector<double> at(spec.columns.size());
+            {
+                LOG_DURATION("20000 knn " + label);
+                for (size_t target : targets)
+                {
+                    for (size_t axis = 0; axis < at.size(); axis++)
+                    {
+                        at[axis] = pacientes[target].*fields[spec.columns[axis]];
+                    }
+                    found += index->find_nearest(at, 10).size();
+                }
+            }
+            IndexStats stats = index->stats();
+            cout << label << ": height=" << stats.height << " nodes=" << stats.nodes
+                 << " total_overlap=" << stats.total_overlap << " results=" << found << endl;
+        }
+    }
+    using Tree = RStarTree<Paciente, columnasPaciente, 10, 20, double, true>;
+    Tree tree;
+    FeatureNormalizer<columnasPaciente> normalizer;
+    auto features = [](const Paciente &paciente)
+    {
+        array<double, columnasPaciente> values;
+        for (size_t columna = 0; columna < columnasPaciente; columna++)
+        {
+            values[columna] = paciente.*camposPaciente[columna];
+        }
+        return values;
+    };
+    for (const Paciente &paciente : pacientes)
+    {
+        normalizer.observe(features(paciente));
+    }
+    for (const Paciente &paciente : pacientes)
+    {
+        tree.insert(paciente, normalizer.point(features(paciente)));
+    }
+    size_t found = 0;
+    {
+        LOG_DURATION("20000 knn compiled-in tree (11 columns, cap 20)");
+        for (size_t target : targets)
+        {
+            found += tree.find_nearest(normalizer.point(features(pacientes[target])), 10).size();
+        }
+    }
+    cout << "compiled-in tree: results=" << found << endl;
+}
+
+/*
+planificadorDeBusquedas compara, para ventanas cúbicas cada vez más
+anchas (una fracción del lado del espacio), el árbol (find_leaf()),
+el recorrido secuencial (find_objects_scan()) y la búsqueda con el
+planificador activo. Reporta la estimación de resultados frente a la
+cantidad real y cuántas búsquedas eligieron el recorrido secuencial.
+*/
+template <typename Tree>
+void planificadorDeBusquedas(const string &label, Tree &tree, const vector<vector<double>> &centers,
+                             const typename Tree::Area &space)
+{
+    constexpr size_t D = tuple_size<decltype(Tree::Point::coords)>::value;
+    tree.enable_planner();
+    for (double fraction : {0.01, 0.05, 0.1, 0.25, 0.5, 0.75, 1.0})
+    {
+        vector<typename Tree::Area> windows;
+        for (const vector<double> &center : centers)
+        {
+            typename Tree::Area window;
+            for (size_t axis = 0; axis < D; axis++)
+            {
+                double half = fraction * (space.max_edges[axis] - space.min_edges[axis]) / 2;
+                window.min_edges[axis] = center[axis] - half;
+                window.max_edges[axis] = center[axis] + half;
+            }
+            windows.push_back(window);
+        }
+        string width = label + " width " + to_string(fraction);
+        size_t found = 0, scans = 0;
+        double estimated = 0;
+        tree.find_objects_scan(windows.front()); // builds the packed rows outside the timings
+        tree.planner = false;
+        {
+            LOG_DURATION("tree    " + width);
+            for (auto &window : windows)
+                found += tree.find_objects_in_area(window).size();
+        }
+        {
+            LOG_DURATION("scan    " + width);
+            for (auto &window : windows)
+                tree.find_objects_scan(window);
+        }
+        tree.planner = true;
+        {
+            LOG_DURATION("planned " + width);
+            for (auto &window : windows)
+                tree.find_objects_in_area(window);
+        }
+        for (auto &window : windows)
+        {
+            auto plan = tree.plan_query(window);
+            estimated += plan.estimated_results;
+            scans += plan.scan;
+        }
+        cout << width << ": results=" << found << " estimated=" << size_t(estimated)
+             << " scans=" << scans << "/" << windows.size() << endl;
+    }
+}
+
+void benchmarkPlanificador()
+{
+    auto points = leerPuntos("./Files/20000.csv");
+    RStarTree<size_t, 3, 10, 20, double, true> tree;
+    RStarBoundingBox<3> space;
+    for (size_t axis = 0; axis < 3; axis++)
+    {
+        space.min_edges[axis] = 0;
+        space.max_edges[axis] = 20000;
+    }
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        RStarPoint<3> point;
+        copy(points[i].begin(), points[i].end(), point.coords.begin());
+        tree.insert(i, point);
+    }
+    mt19937 gen(50);
+    uniform_int_distribution<size_t> pick(0, points.size() - 1);
+    vector<vector<double>> centers(200);
+    for (auto &center : centers)
+        center = points[pick(gen)];
+    planificadorDeBusquedas("20000.csv", tree, centers, space);
+
+    const size_t D = 11;
+    auto rows = leerPuntos("./Files/covid_DB_datos_importantes_completos_double.csv", true);
+    RStarTree<size_t, D, 10, 20, double, true> covid;
+    RStarBoundingBox<D> bounds;
+    for (size_t axis = 0; axis < D; axis++)
+    {
+        bounds.min_edges[axis] = numeric_limits<double>::max();
+        bounds.max_edges[axis] = numeric_limits<double>::lowest();
+    }
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+        RStarPoint<D> point;
+        for (size_t axis = 0; axis < D; axis++)
+        {
+            point.coords[axis] = rows[i][axis];
+            bounds.min_edges[axis] = min(bounds.min_edges[axis], rows[i][axis]);
+            bounds.max_edges[axis] = max(bounds.max_edges[axis], rows[i][axis]);
+        }
+        covid.insert(i, point);
+    }
+    uniform_int_distribution<size_t> pick_row(0, rows.size() - 1);
+    for (auto &center : centers)
+        center = rows[pick_row(gen)];
+    planificadorDeBusquedas("covid", covid, centers, bounds);
+}
+
+/*
+comprobarCursor recorre con QueryCursor las mismas ventanas de
+Files/20000.csv que find_objects(), de a páginas de 1, 7 y 100
+valores: cada página termina con token() y la siguiente sigue con
+resume_cursor(). Un quinto de los puntos se inserta dos veces, así
+algunas páginas cortan una hoja agrupada a la mitad; una ventana que
+cubre todo el espacio prueba los subárboles cubiertos. Se comparan los
+valores entregados con los de find_objects() para los cuatro
+predicados (find_objects_in_area() para overlaps).
+*/
+void comprobarCursor()
+{
+    using Tree = RStarTree<size_t, 3, 10, 20>;
+    auto points = leerPuntos("./Files/20000.csv");
+    Tree tree;
+    tree.bucket_duplicates = true;
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        tree.insert(i, cajaDePunto<3, double>(points[i]));
+        if (i % 5 == 0)
+            tree.insert(points.size() + i, cajaDePunto<3, double>(points[i]));
+    }
+    vector<Tree::Area> windows;
+    for (auto &corner : ventanasAleatorias(points, 100, 1500))
+    {
+        Tree::Area window;
+        for (size_t axis = 0; axis < 3; axis++)
+        {
+            window.min_edges[axis] = corner[axis];
+            window.max_edges[axis] = corner[axis] + 1500;
+        }
+        windows.push_back(window);
+    }
+    Tree::Area everything;
+    for (size_t axis = 0; axis < 3; axis++)
+    {
+        everything.min_edges[axis] = -numeric_limits<double>::infinity();
+        everything.max_edges[axis] = numeric_limits<double>::infinity();
+    }
+    windows.push_back(everything);
+    windows.push_back(cajaDePunto<3, double>(points[0])); // contains: only the boxes equal to it
+
+    size_t mismatches = 0, pages = 0;
+    for (query_type type : {query_type::intersects, query_type::within, query_type::contains,
+                            query_type::overlaps})
+    {
+        for (const Tree::Area &window : windows)
+        {
+            vector<size_t> expected;
+            for (const auto &leaf : type == query_type::overlaps ? tree.find_objects_in_area(window)
+                                                                 : tree.find_objects(window, type))
+                expected.push_back(leaf.get_value());
+            sort(expected.begin(), expected.end());
+            for (size_t page : {1, 7, 100})
+            {
+                vector<size_t> drained;
+                Tree::QueryCursor cursor = tree.open_cursor(window, type);
+                cursor.limit(page);
+                Tree::LeafWithConstBox leaf(nullptr);
+                while (true)
+                {
+                    size_t before = drained.size();
+                    while (cursor.next(leaf))
+                        drained.push_back(leaf.get_value());
+                    mismatches += drained.size() - before > page;
+                    pages++;
+                    if (cursor.exhausted())
+                        break;
+                    cursor = tree.resume_cursor(cursor.token());
+                    cursor.limit(page);
+                }
+                sort(drained.begin(), drained.end());
+                mismatches += drained != expected;
+            }
+        }
+    }
+    cout << "cursor: " << pages << " pages over " << windows.size() << " windows x 4 predicates" << endl;
+    informarComprobacion("check cursor", mismatches);
+}
+
+/*
+comprobarCondensacion borra con erase_key() dos tercios de los valores
+del árbol de Files/20000.csv y mueve con update_key() la mitad de los
+que quedan a otra posición, de a uno y en orden aleatorio. Al final
+cuenta los nodos (salvo la raíz) con menos de min_child_items hijos y
+compara 300 búsquedas por área con un recorrido lineal de las cajas
+que deberían quedar.
+*/
+void comprobarCondensacion()
+{
+    using Tree = RStarTree<uint32_t, 3, 10, 20>;
+    auto points = leerPuntos("./Files/20000.csv");
+    Tree tree;
+    tree.enable_key_index([](uint32_t row)
+                          { return Tree::Handle(row); });
+    vector<Tree::Area> boxes;
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        boxes.push_back(cajaDePunto<3, double>(points[i]));
+        tree.insert(uint32_t(i), boxes.back());
+    }
+    vector<size_t> order(points.size());
+    iota(order.begin(), order.end(), 0);
+    mt19937 gen(45);
+    shuffle(order.begin(), order.end(), gen);
+    vector<bool> alive(points.size(), true);
+    for (size_t k = 0; k < order.size(); k++)
+    {
+        size_t i = order[k];
+        if (k % 3 != 2)
+        {
+            tree.erase_key(i);
+            alive[i] = false;
+        }
+        else if (k % 2 == 0)
+        { // moved to another point's place
+            boxes[i] = boxes[order[k / 2]];
+            tree.update_key(i, boxes[i]);
+        }
+    }
+    size_t underfull = 0, nodes = 0;
+    tree.walk_tree([&](size_t depth, const Tree::Area &, size_t children)
+                   {
+                       nodes++;
+                       underfull += depth > 0 && children < 10;
+                   },
+                   [](size_t, const Tree::LeafWithConstBox &) {});
+    size_t mismatches = underfull;
+    for (auto &corner : ventanasAleatorias(points, 300, 1500))
+    {
+        Tree::Area window = cajaDePunto<3, double>(corner);
+        for (size_t axis = 0; axis < 3; axis++)
+            window.max_edges[axis] += 1499;
+        vector<size_t> found, expected;
+        for (const auto &leaf : tree.find_objects_in_area(window))
+            found.push_back(leaf.get_value());
+        for (size_t i = 0; i < boxes.size(); i++)
+        {
+            if (alive[i] && window.is_intersected(boxes[i]))
+                expected.push_back(i);
+        }
+        sort(found.begin(), found.end());
+        mismatches += found != expected;
+    }
+    cout << "condense: values=" << tree.size_ << " nodes=" << nodes << " underfull=" << underfull << endl;
+    informarComprobacion("check condense", mismatches);
+}
+
+int main(int argc, char **argv)
+{
+    string name = argc > 1 ? argv[1] : "";
+    unsigned max_threads = argc > 2 ? stoul(argv[2]) : max(thread::hardware_concurrency(), 1u);
+    if (name.empty() || name == "quality")
+        benchmarkCalidad();
+    if (name.empty() || name == "duplicates")
+        benchmarkDuplicados();
+    if (name.empty() || name == "highdim")
+        benchmarkAltaDimension();
+    if (name.empty() || name == "points")
+        benchmarkPuntos();
+    if (name.empty() || name == "relayout")
+        benchmarkRelayout();
+    if (name.empty() || name == "bulk")
+        benchmarkConstruccionMasiva(max_threads);
+    if (name.empty() || name == "parallelquery")
+        benchmarkConsultaParalela(max_threads);
+    if (name.empty() || name == "ingest")
+        benchmarkIngesta(max_threads);
+    if (name.empty() || name == "rawcsv")
+        benchmarkCsvCrudo(max_threads);
+    if (name.empty() || name == "columnar")
+        benchmarkColumnar();
+    if (name.empty() || name == "wal")
+        benchmarkWal();
+    if (name.empty() || name == "checkpoint")
+        benchmarkCheckpoint();
+    if (name.empty() || name == "export")
+        benchmarkExportacion();
+    if (name.empty() || name == "keyindex")
+        benchmarkIndiceClave();
+    if (name.empty() || name == "sphere")
+        benchmarkEsfera();
+    if (name.empty() || name == "factory")
+        benchmarkFabrica();
+    if (name.empty() || name == "planner")
+        benchmarkPlanificador();
+    if (name.empty() || name == "cursor")
+        comprobarCursor();
+    if (name.empty() || name == "condense")
+        comprobarCondensacion();
+    return comprobacionesFallidas > 0;
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <algorithm>
+#include <array>
 #include <limits>
 #include <vector>
 
@@ -11,17 +12,30 @@ enum class axis_type
 };
 
 
-template <size_t dimensions>
+template <size_t dimensions, typename cost_type = double>
+struct RStarPoint;
+
+/*
+cost_type es el tipo en el que se calculan las métricas de costo
+(`margin`, `area`, `overlap` y `dist_between_centers`). Los bordes
+siempre se guardan en `double`; por defecto el costo también se
+calcula en `double`, lo que evita que un área 3-D con coordenadas de
+unos 15000 desborde 32 bits y que las cajas con bordes fraccionarios
+se trunquen a área cero. Para datos enteros puede usarse `int64_t`.
+*/
+template <size_t dimensions, typename cost_type = double>
 struct RStarBoundingBox
 {
+    using Point = RStarPoint<dimensions, cost_type>;
+
     vector<double> max_edges, min_edges; //<borders
     
     RStarBoundingBox() : max_edges(dimensions), min_edges(dimensions)
     {
         for (size_t axis = 0; axis < dimensions; axis++)
         {
-            max_edges[axis] = numeric_limits<int>::min();
-            min_edges[axis] = numeric_limits<int>::max();
+            max_edges[axis] = numeric_limits<double>::lowest();
+            min_edges[axis] = numeric_limits<double>::max();
         }
     }
     ~RStarBoundingBox() = default;
@@ -34,7 +48,7 @@ struct RStarBoundingBox
     }
     bool operator==(const RStarBoundingBox &rhs) const
     {
-        return max_edges == max_edges && min_edges == min_edges;
+        return max_edges == rhs.max_edges && min_edges == rhs.min_edges;
     }
     bool operator!=(const RStarBoundingBox &rhs) const
     {
@@ -53,16 +67,16 @@ struct RStarBoundingBox
 
     2. Dentro del bucle `for`, recorre cada eje (dimensión) del cuadro delimitador:
 
-        - `max_edges[axis] = numeric_limits<int>::min();`: Establece 
+        - `max_edges[axis] = numeric_limits<double>::lowest();`: Establece 
         el límite máximo (`max_edges`) en el eje actual al valor mínimo 
-        posible para un entero (`numeric_limits<int>::min()`). 
+        posible para un double (`numeric_limits<double>::lowest()`). 
         Este valor se utiliza para restablecer el límite máximo a un 
         valor inicial que permitirá expandir el cuadro delimitador 
         cuando sea necesario.
 
-        - `min_edges[axis] = numeric_limits<int>::max();`: Establece 
+        - `min_edges[axis] = numeric_limits<double>::max();`: Establece 
         el límite mínimo (`min_edges`) en el eje actual al valor máximo 
-        posible para un entero (`numeric_limits<int>::max()`). 
+        posible para un double (`numeric_limits<double>::max()`). 
         Este valor se utiliza para restablecer el límite mínimo a un 
         valor inicial que permitirá ajustar el cuadro delimitador 
         correctamente cuando sea necesario.
@@ -80,8 +94,8 @@ struct RStarBoundingBox
     {
         for (size_t axis = 0; axis < dimensions; axis++)
         {
-            max_edges[axis] = numeric_limits<int>::min();
-            min_edges[axis] = numeric_limits<int>::max();
+            max_edges[axis] = numeric_limits<double>::lowest();
+            min_edges[axis] = numeric_limits<double>::max();
         }
     }
 
@@ -92,7 +106,7 @@ struct RStarBoundingBox
      completamente otra área dentro de él. 
      Aquí está la explicación detallada:
 
-    1. `void stretch(const RStarBoundingBox<dimensions> &other_box)`: 
+    1. `void stretch(const RStarBoundingBox &other_box)`: 
     Esta función toma como argumento otro cuadro delimitador 
     (`BoundingBox`) al que se quiere ajustar el cuadro delimitador actual.
 
@@ -122,7 +136,7 @@ struct RStarBoundingBox
     Esto se hace actualizando los límites máximos y mínimos 
     en cada dimensión para englobar completamente la otra área.
     */
-    void stretch(const RStarBoundingBox<dimensions> &other_box)
+    void stretch(const RStarBoundingBox &other_box)
     {
         for (size_t axis = 0; axis < dimensions;
              axis++)
@@ -132,6 +146,16 @@ struct RStarBoundingBox
         }
     }
 
+    // Versión para puntos: cada eje se ajusta con una sola coordenada.
+    void stretch(const Point &point)
+    {
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            max_edges[axis] = max(max_edges[axis], point.coords[axis]);
+            min_edges[axis] = min(min_edges[axis], point.coords[axis]);
+        }
+    }
+
 
 
     /*
@@ -139,7 +163,7 @@ struct RStarBoundingBox
     determina si dos cajas delimitadoras (`RStarBoundingBox`) se 
     intersectan entre sí. Aquí está su explicación:
 
-    - `bool is_intersected(const RStarBoundingBox<dimensions> &other_box) const`: 
+    - `bool is_intersected(const RStarBoundingBox &other_box) const`: 
     Esta función toma una caja delimitadora (`other_box`) como 
     argumento y verifica la intersección con la caja actual.
 
@@ -155,13 +179,12 @@ struct RStarBoundingBox
         - De lo contrario, si el área de intersección es cero o negativa,
          devuelve `false` para indicar que no hay superposición entre las cajas.
 
-    En resumen, esta función actúa como un verificador de intersección 
-    entre dos cajas delimitadoras, devolviendo `true` si hay una 
-    intersección y `false` si no la hay. Esto es útil al determinar 
-    si dos áreas definidas por las cajas delimitadoras se superponen 
-    entre sí.
+    Es el predicado de find_objects_in_area() y
+    delete_objects_in_area(): una caja degenerada (de volumen cero) no
+    se intersecta con nada. Las búsquedas con query_type (intersects,
+    within, contains) usan en cambio los núcleos de abajo.
     */
-    bool is_intersected(const RStarBoundingBox<dimensions> &other_box) const
+    bool is_intersected(const RStarBoundingBox &other_box) const
     {
         if (overlap(other_box) > 0)
             return true; // Returns true if the intersection is greater than 0
@@ -170,6 +193,108 @@ struct RStarBoundingBox
     }
 
 
+    /*
+    `intersects` es el núcleo booleano de intersección. En cada eje
+    toma el mayor de los límites inferiores (`lo`) y el menor de los
+    límites superiores (`hi`):
+
+    - Si `lo < hi` las cajas comparten un tramo de longitud positiva
+    en ese eje (lo mismo que exigía `overlap() > 0`).
+    - Si `lo == hi` solo se acepta cuando alguna de las dos cajas es
+    degenerada en ese eje (un punto sobre el borde de la otra caja);
+    dos cajas que apenas se tocan por una cara siguen sin intersectarse.
+    - En otro caso devuelve `false` de inmediato, sin revisar los
+    ejes restantes.
+    */
+    bool intersects(const RStarBoundingBox &other_box) const
+    {
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            double lo = max(min_edges[axis], other_box.min_edges[axis]);
+            double hi = min(max_edges[axis], other_box.max_edges[axis]);
+            if (lo < hi)
+                continue;
+            if (lo == hi && (min_edges[axis] == max_edges[axis] ||
+                             other_box.min_edges[axis] == other_box.max_edges[axis]))
+                continue;
+            return false; // early exit on the first separating axis
+        }
+        return true;
+    }
+
+
+    /*
+    `touches` es la intersección cerrada: acepta también cajas que
+    solo comparten un borde. Se usa para podar nodos internos, porque
+    un nodo que apenas toca la consulta puede contener puntos
+    (cajas degeneradas) sobre ese mismo borde.
+    */
+    bool touches(const RStarBoundingBox &other_box) const
+    {
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            if (max(min_edges[axis], other_box.min_edges[axis]) >
+                min(max_edges[axis], other_box.max_edges[axis]))
+                return false;
+        }
+        return true;
+    }
+
+
+    /*
+    `contains` devuelve `true` si `other_box` queda completamente
+    dentro de la caja actual (bordes incluidos). Corta en el primer
+    eje donde `other_box` se sale.
+    */
+    bool contains(const RStarBoundingBox &other_box) const
+    {
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            if (other_box.min_edges[axis] < min_edges[axis] ||
+                other_box.max_edges[axis] > max_edges[axis])
+                return false;
+        }
+        return true;
+    }
+
+
+    /*
+    `within` es la relación inversa de `contains`: la caja actual
+    está completamente dentro de `other_box`.
+    */
+    bool within(const RStarBoundingBox &other_box) const
+    {
+        return other_box.contains(*this);
+    }
+
+
+    /*
+    Núcleos punto-en-caja usados por las hojas puntuales: un punto
+    está en la caja si cada coordenada cae entre los bordes (incluidos).
+    Para un punto, intersectar y estar contenido son lo mismo.
+    */
+    bool contains(const Point &point) const
+    {
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            if (point.coords[axis] < min_edges[axis] ||
+                point.coords[axis] > max_edges[axis])
+                return false;
+        }
+        return true;
+    }
+
+    bool intersects(const Point &point) const
+    {
+        return contains(point);
+    }
+
+    bool is_intersected(const Point &point) const
+    {
+        return contains(point);
+    }
+
+
     /*
     `margin()` calcula el margen o borde 
     alrededor de la caja delimitadora (`BoundingBox`). 
@@ -178,14 +303,14 @@ struct RStarBoundingBox
 
     Aquí está el desglose de la función:
 
-    - `int ans = 0;`: Se inicializa la variable `ans` como cero, 
+    - `cost_type ans = 0;`: Se inicializa la variable `ans` como cero, 
     la cual almacenará el cálculo total del margen.
 
     - El bucle `for` itera a través de cada dimensión del espacio 
     (considerando que la caja delimitadora puede ser multidimensional):
         - `for (size_t axis = 0; axis < dimensions; axis++)`: 
         Itera a través de cada dimensión del espacio.
-        - `ans += max_edges[axis] - min_edges[axis];`: 
+        - `ans += side(axis);`: 
         Para cada dimensión, se calcula la longitud del lado 
         restando el valor mínimo del borde al valor máximo 
         del borde en esa dimensión. Esto se hace para todas 
@@ -195,13 +320,13 @@ struct RStarBoundingBox
     bordes de la caja delimitadora en todas las dimensiones, 
     lo que representa el margen total alrededor de la caja.
     */
-    int margin() const
+    cost_type margin() const
     {
-        int ans = 0;
+        cost_type ans = 0;
         for (size_t axis = 0; axis < dimensions;
              axis++)
         { // Calculates the sum of the umbrellas
-            ans += max_edges[axis] - min_edges[axis];
+            ans += side(axis);
         }
         return ans;
     }
@@ -216,13 +341,13 @@ struct RStarBoundingBox
 
     Aquí está el desglose de la función:
 
-    - `int ans = 1;`: Se inicializa la variable `ans` como uno. 
+    - `cost_type ans = 1;`: Se inicializa la variable `ans` como uno. 
     Esta variable almacenará el cálculo total del área.
 
     - El bucle `for` itera a través de cada dimensión del espacio:
         - `for (size_t axis = 0; axis < dimensions; axis++)`: 
         Itera a través de cada dimensión del espacio.
-        - `ans *= max_edges[axis] - min_edges[axis];`: 
+        - `ans *= side(axis);`: 
         Para cada dimensión, se calcula la longitud del lado
          multiplicando el valor mínimo del borde por el valor
           máximo del borde en esa dimensión. Esto se hace para
@@ -233,24 +358,35 @@ struct RStarBoundingBox
     de los lados de la caja delimitadora en todas las dimensiones,
      lo que representa el área total de la caja en el espacio multidimensional.
     */
-    int area() const
+    cost_type area() const
     { // Calculates surface area
-        int ans = 1;
+        cost_type ans = 1;
         for (size_t axis = 0; axis < dimensions; axis++)
         {
-            ans *= max_edges[axis] - min_edges[axis];
+            ans *= side(axis);
         }
         return ans;
     }
 
 
+    /*
+    `side` devuelve la longitud de la caja en un eje, ya convertida
+    a `cost_type`. Una caja vacía (recién reiniciada con `reset`)
+    tiene longitud cero en lugar de un valor negativo enorme.
+    */
+    cost_type side(size_t axis) const
+    {
+        return static_cast<cost_type>(max(0.0, max_edges[axis] - min_edges[axis]));
+    }
+
+
 
     /*
     La función `overlap` calcula el área de intersección 
     entre dos cajas delimitadoras en un espacio de múltiples 
     dimensiones. Aquí está su explicación detallada:
 
-    - `int overlap(const RStarBoundingBox<dimensions> &other_box) const`: 
+    - `cost_type overlap(const RStarBoundingBox &other_box) const`: 
     Esta función toma otra caja delimitadora (`other_box`) como 
     argumento y calcula el área de intersección con la caja 
     delimitadora actual.
@@ -291,15 +427,15 @@ struct RStarBoundingBox
     el área de intersección total entre dos cajas delimitadoras en 
     un espacio de múltiples dimensiones.
     */
-    int overlap(const RStarBoundingBox<dimensions> &other_box) const
+    cost_type overlap(const RStarBoundingBox &other_box) const
     {
-        int ans = 1;
+        cost_type ans = 1;
         for (size_t axis = 0; axis < dimensions; axis++)
         {
-            int x1 = min_edges[axis];           // lower limit
-            int x2 = max_edges[axis];           // larger limit
-            int y1 = other_box.min_edges[axis]; // smallest limit
-            int y2 = other_box.max_edges[axis]; // larger limit
+            double x1 = min_edges[axis];           // lower limit
+            double x2 = max_edges[axis];           // larger limit
+            double y1 = other_box.min_edges[axis]; // smallest limit
+            double y2 = other_box.max_edges[axis]; // larger limit
 
             if (x1 < y1)
             {
@@ -307,11 +443,11 @@ struct RStarBoundingBox
                 {
                     if (y2 < x2)
                     {
-                        ans *= (y2 - y1);
+                        ans *= static_cast<cost_type>(y2 - y1);
                     }
                     else
                     {
-                        ans *= (x2 - y1);
+                        ans *= static_cast<cost_type>(x2 - y1);
                     }
                 }
                 else
@@ -325,11 +461,11 @@ struct RStarBoundingBox
                 {
                     if (y2 > x2)
                     {
-                        ans *= (x2 - x1);
+                        ans *= static_cast<cost_type>(x2 - x1);
                     }
                     else
                     {
-                        ans *= (y2 - x1);
+                        ans *= static_cast<cost_type>(y2 - x1);
                     }
                 }
                 else
@@ -352,7 +488,7 @@ struct RStarBoundingBox
 
     Aquí está el desglose de la función:
 
-    - `int ans = 0;`: Se inicializa la variable `ans` como cero. 
+    - `cost_type ans = 0;`: Se inicializa la variable `ans` como cero. 
     Esta variable almacenará la suma de los cuadrados de 
     las diferencias en cada dimensión entre los centros de 
     las cajas delimitadoras.
@@ -360,7 +496,7 @@ struct RStarBoundingBox
     - El bucle `for` itera a través de cada dimensión del espacio:
         - `for (size_t axis = 0; axis < dimensions; axis++)`: 
         Itera a través de cada dimensión del espacio.
-        - `int d = ((max_edges[axis] + min_edges[axis]) -
+        - `cost_type d = ((max_edges[axis] + min_edges[axis]) -
          (other_box.max_edges[axis] + other_box.min_edges[axis])) / 2;`: 
          Para cada dimensión, calcula la distancia entre los
           centros de las cajas delimitadoras en esa dimensión. 
@@ -377,16 +513,17 @@ struct RStarBoundingBox
        realizar una operación de raíz cuadrada, lo que puede 
        ahorrar en términos de precisión y tiempo de cálculo.
     */
-    double dist_between_centers(const RStarBoundingBox<dimensions> &other_box) const
+    cost_type dist_between_centers(const RStarBoundingBox &other_box) const
     {
         // The result is the distance squared so as not to lose accuracy from the
         // square root.
-        int ans = 0;
+        cost_type ans = 0;
         for (size_t axis = 0; axis < dimensions; axis++)
         {
-            int d = ((max_edges[axis] + min_edges[axis]) -
-                     (other_box.max_edges[axis] + other_box.min_edges[axis])) /
-                    2;
+            cost_type d = static_cast<cost_type>(
+                ((max_edges[axis] + min_edges[axis]) -
+                 (other_box.max_edges[axis] + other_box.min_edges[axis])) /
+                2);
             ans += d * d;
         }
         return ans;
@@ -398,7 +535,7 @@ struct RStarBoundingBox
      `value_of_axis`, devuelve el valor 
     de borde en un eje específico de la caja delimitadora.
 
-    - `int value_of_axis(const int axis, const axis_type type) const`: 
+    - `double value_of_axis(const int axis, const axis_type type) const`: 
     Esta función toma dos argumentos: `axis`, que representa
      la dimensión o eje para el que se quiere obtener el 
      valor del borde, y `type`, que indica si se busca el 
@@ -422,7 +559,7 @@ struct RStarBoundingBox
     inferior o superior, según lo especificado por `type`,
      en el eje o dimensión indicado por `axis` en la caja delimitadora.
     */
-    int value_of_axis(const int axis, const axis_type type) const
+    double value_of_axis(const int axis, const axis_type type) const
     {
         if (type == axis_type::lower)
         {
@@ -434,4 +571,70 @@ struct RStarBoundingBox
         }
     }
     
-};
\ No newline at end of file
+};
+
+
+/*
+RStarPoint es la geometría de las hojas puntuales: guarda una sola
+tupla de coordenadas en lugar de los vectores `min_edges` y
+`max_edges` de una caja, lo que reduce a la mitad lo que ocupa la
+geometría de cada hoja y evita estirar nodos con cajas degeneradas.
+
+Ofrece la misma interfaz que usa el árbol sobre las cajas de sus
+hijos (`value_of_axis`, `dist_between_centers`, `within`, `contains`)
+para que la división y la reinserción forzada no distingan entre
+hojas puntuales y hojas con caja.
+*/
+template <size_t dimensions, typename cost_type>
+struct RStarPoint
+{
+    using BoundingBox = RStarBoundingBox<dimensions, cost_type>;
+
+    array<double, dimensions> coords{};
+
+    bool operator<(const RStarPoint &rhs) const { return coords < rhs.coords; }
+    bool operator==(const RStarPoint &rhs) const { return coords == rhs.coords; }
+    bool operator!=(const RStarPoint &rhs) const { return !operator==(rhs); }
+
+    // Caja degenerada equivalente, para código que necesita una caja.
+    BoundingBox to_box() const
+    {
+        BoundingBox box;
+        box.stretch(*this);
+        return box;
+    }
+
+    double value_of_axis(const int axis, const axis_type) const
+    {
+        return coords[axis];
+    }
+
+    // Distancia al cuadrado entre el punto y el centro de `box`.
+    cost_type dist_between_centers(const BoundingBox &box) const
+    {
+        cost_type ans = 0;
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            cost_type d = static_cast<cost_type>(
+                coords[axis] - (box.max_edges[axis] + box.min_edges[axis]) / 2);
+            ans += d * d;
+        }
+        return ans;
+    }
+
+    bool within(const BoundingBox &box) const
+    {
+        return box.contains(*this);
+    }
+
+    // Un punto solo contiene a una caja degenerada en ese mismo punto.
+    bool contains(const BoundingBox &box) const
+    {
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            if (box.min_edges[axis] != coords[axis] || box.max_edges[axis] != coords[axis])
+                return false;
+        }
+        return true;
+    }
+};
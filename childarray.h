@@ -0,0 +1,113 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+using namespace std;
+
+/*
+ChildArray es el contenedor de hijos de un nodo del árbol R*. Guarda
+hasta `inline_capacity` elementos dentro del propio objeto, sin
+memoria dinámica, de modo que el encabezado del nodo y sus hijos
+quedan contiguos. El árbol lo dimensiona con max_child_items + 1, que
+es lo máximo que un nodo normal llega a tener antes de dividirse.
+
+Si alguna vez se supera esa capacidad, todos los elementos pasan a un
+vector en el heap, y vuelven al arreglo interno cuando el contenedor
+se achica otra vez.
+
+La interfaz es el subconjunto de vector que usa el árbol: acceso por
+índice, iteradores de puntero, push_back (también con back_inserter),
+pop_back, erase de un rango y resize.
+*/
+template <typename T, size_t inline_capacity>
+class ChildArray
+{
+public:
+    using value_type = T;
+    using iterator = T *;
+    using const_iterator = const T *;
+    using reverse_iterator = std::reverse_iterator<T *>;
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool spilled() const { return on_heap; }
+
+    T *data() { return spilled() ? heap.data() : items; }
+    const T *data() const { return spilled() ? heap.data() : items; }
+
+    T &operator[](size_t i) { return data()[i]; }
+    const T &operator[](size_t i) const { return data()[i]; }
+    T &front() { return data()[0]; }
+    T &back() { return data()[count - 1]; }
+
+    iterator begin() { return data(); }
+    iterator end() { return data() + count; }
+    const_iterator begin() const { return data(); }
+    const_iterator end() const { return data() + count; }
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+
+    void push_back(const T &value)
+    {
+        if (!on_heap && count == inline_capacity)
+        { // outgrows the inline array
+            spill();
+        }
+        if (spilled())
+            heap.push_back(value);
+        else
+            items[count] = value;
+        count++;
+    }
+
+    void pop_back()
+    {
+        resize(count - 1);
+    }
+
+    void erase(iterator first, iterator last)
+    {
+        iterator tail = copy(last, end(), first);
+        resize(tail - begin());
+    }
+
+    void resize(size_t new_count)
+    {
+        if (new_count > inline_capacity && !on_heap)
+        {
+            spill();
+        }
+        if (on_heap)
+        {
+            heap.resize(new_count);
+            if (new_count <= inline_capacity)
+            { // back to the inline array
+                copy(heap.begin(), heap.end(), items);
+                heap.clear();
+                heap.shrink_to_fit();
+                on_heap = false;
+            }
+        }
+        else
+        {
+            fill(items + min(count, new_count), items + new_count, T());
+        }
+        count = new_count;
+    }
+
+    void clear() { resize(0); }
+
+private:
+    void spill()
+    {
+        heap.assign(items, items + count);
+        on_heap = true;
+    }
+
+    size_t count{0};
+    bool on_heap{false};
+    T items[inline_capacity]{};
+    vector<T> heap;
+};
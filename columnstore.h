@@ -0,0 +1,148 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+/*
+ColumnStore guarda los atributos de los registros fuera del árbol, en
+columnas: un arreglo contiguo por atributo. El árbol se instancia
+entonces con LeafType = ColumnStore::RowId (32 bits) y cada hoja solo
+lleva el número de fila, en lugar del registro completo (un Paciente
+ocupa 96 bytes), así las hojas son más chicas y recorrer el árbol no
+trae los atributos a la caché.
+
+Los filtros y agregados posteriores a una búsqueda trabajan sobre la
+lista de filas del resultado (ver row_ids()):
+
+* gather() copia los valores de una columna para esas filas a un
+búfer contiguo; el resto de las operaciones recorre ese búfer en
+bloques de 4 sin saltos, para que el compilador las vectorice. El
+búfer es propio de cada hilo, así que varios hilos pueden filtrar a la
+vez sobre el mismo almacén.
+* filter() deja en la lista solo las filas cuyo valor en la columna
+está en [lo, hi]. La compactación no usa ifs: cada fila se escribe y
+el índice de salida avanza según la comparación.
+* aggregate() devuelve cantidad, suma, mínimo, máximo y media de una
+columna sobre las filas.
+*/
+struct ColumnAggregate
+{
+    size_t count{0};
+    double sum{0};
+    double min_value{numeric_limits<double>::infinity()};
+    double max_value{-numeric_limits<double>::infinity()};
+
+    double mean() const { return count > 0 ? sum / count : 0; }
+};
+
+template <size_t columns>
+class ColumnStore
+{
+public:
+    using RowId = uint32_t;
+    using Row = array<double, columns>;
+
+    size_t size() const { return data[0].size(); }
+
+    void reserve(size_t rows)
+    {
+        for (vector<double> &column : data)
+            column.reserve(rows);
+    }
+
+    RowId append(const Row &values)
+    {
+        if (size() > numeric_limits<RowId>::max())
+        {
+            throw invalid_argument("column store is full (32-bit row ids)");
+        }
+        for (size_t c = 0; c < columns; c++)
+            data[c].push_back(values[c]);
+        return RowId(size() - 1);
+    }
+
+    const double *column(size_t c) const { return data[c].data(); }
+    double value(RowId row, size_t c) const { return data[c][row]; }
+
+    Row row(RowId row) const
+    {
+        Row values;
+        for (size_t c = 0; c < columns; c++)
+            values[c] = data[c][row];
+        return values;
+    }
+
+    void gather(const vector<RowId> &rows, size_t c, vector<double> &out) const
+    {
+        const double *values = data[c].data();
+        out.resize(rows.size());
+        for (size_t i = 0; i < rows.size(); i++)
+            out[i] = values[rows[i]];
+    }
+
+    void filter(vector<RowId> &rows, size_t c, double lo, double hi) const
+    {
+        thread_local vector<double> values;
+        gather(rows, c, values);
+        size_t kept = 0;
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+            rows[kept] = rows[i];
+            kept += (values[i] >= lo) & (values[i] <= hi);
+        }
+        rows.resize(kept);
+    }
+
+    ColumnAggregate aggregate(const vector<RowId> &rows, size_t c) const
+    {
+        thread_local vector<double> values;
+        gather(rows, c, values);
+        ColumnAggregate result;
+        result.count = values.size();
+        double sum[4] = {0, 0, 0, 0};
+        double lo[4], hi[4];
+        fill(lo, lo + 4, result.min_value);
+        fill(hi, hi + 4, result.max_value);
+        size_t i = 0;
+        for (; i + 4 <= values.size(); i += 4)
+        { // four independent lanes
+            for (size_t lane = 0; lane < 4; lane++)
+            {
+                double v = values[i + lane];
+                sum[lane] += v;
+                lo[lane] = v < lo[lane] ? v : lo[lane];
+                hi[lane] = v > hi[lane] ? v : hi[lane];
+            }
+        }
+        for (; i < values.size(); i++)
+        {
+            sum[0] += values[i];
+            lo[0] = min(lo[0], values[i]);
+            hi[0] = max(hi[0], values[i]);
+        }
+        result.sum = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+        result.min_value = min(min(lo[0], lo[1]), min(lo[2], lo[3]));
+        result.max_value = max(max(hi[0], hi[1]), max(hi[2], hi[3]));
+        return result;
+    }
+
+private:
+    array<vector<double>, columns> data;
+};
+
+// Filas de un resultado de búsqueda de un árbol con hojas RowId.
+template <typename Results>
+vector<uint32_t> row_ids(const Results &results)
+{
+    vector<uint32_t> rows;
+    rows.reserve(results.size());
+    for (const auto &leaf : results)
+        rows.push_back(leaf.get_value());
+    return rows;
+}
@@ -0,0 +1,224 @@
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+/*
+Lectura directa de archivos CSV crudos como Files/covid_DB.csv: campos
+entre comillas, más de cien columnas y muchas celdas vacías.
+
+* next_csv_field() corta el siguiente campo de una línea y devuelve una
+vista (string_view) a su contenido, sin las comillas que lo rodean.
+Dentro de comillas una coma no separa campos. Las comillas dobles
+escapadas ("") quedan tal cual en la vista: no se copia el campo para
+deshacerlas, porque las columnas que se proyectan son números o
+etiquetas.
+* read_csv_names() lee la primera línea de un archivo como lista de
+nombres; sirve para el encabezado (Files/dataColumn.csv) y para la
+lista de columnas a proyectar (Files/importantColumns.csv).
+*/
+inline string_view next_csv_field(string_view line, size_t &pos)
+{
+    size_t begin = pos, end;
+    if (pos < line.size() && line[pos] == '"')
+    {
+        begin = pos + 1;
+        end = begin;
+        while (end < line.size())
+        {
+            if (line[end] == '"')
+            {
+                if (end + 1 < line.size() && line[end + 1] == '"')
+                { // escaped quote inside the field
+                    end += 2;
+                    continue;
+                }
+                break;
+            }
+            end++;
+        }
+        pos = min(line.size(), end + 1);
+    }
+    else
+    {
+        end = line.find(',', pos);
+        if (end == string_view::npos)
+            end = line.size();
+        pos = end;
+    }
+    if (pos < line.size() && line[pos] == ',')
+        pos++;
+    else
+        pos = line.size() + 1; // no more fields
+    return line.substr(begin, end - begin);
+}
+
+inline vector<string> read_csv_names(const string &path)
+{
+    ifstream file(path);
+    string line;
+    if (!getline(file, line))
+    {
+        throw invalid_argument("cannot read column names from " + path);
+    }
+    if (!line.empty() && line.back() == '\r')
+        line.pop_back();
+    vector<string> names;
+    for (size_t pos = 0; pos <= line.size();)
+    {
+        names.emplace_back(next_csv_field(line, pos));
+    }
+    return names;
+}
+
+/*
+Qué hacer con una fila a la que le falta una columna proyectada (celda
+vacía o que no es un número ni una etiqueta conocida):
+- skip: la fila se descarta.
+- impute: la celda toma el valor de reemplazo de su columna.
+*/
+enum class MissingPolicy
+{
+    skip,
+    impute
+};
+
+// Resultado de CsvProjection::parse() para una fila.
+enum class RowStatus
+{
+    complete,
+    imputed,
+    skipped
+};
+
+/*
+CsvProjection extrae de cada línea solo las columnas pedidas, buscadas
+por nombre en el encabezado. El constructor arma una tabla de campo a
+posición de salida; parse() recorre la línea una sola vez, convierte
+con from_chars directamente sobre el texto de la línea (sin crear un
+string por campo) y deja de leer después de la última columna que
+necesita.
+
+Las etiquetas `negative` y `positive` (resultado del examen) se leen
+como 0 y 1. Con MissingPolicy::impute, `imputed_values` da el valor de
+reemplazo de cada columna proyectada; si se omite es 0, que en
+covid_DB.csv es la media de las columnas de laboratorio, que ya vienen
+estandarizadas.
+
+parse() es const y no guarda estado, así que varios hilos lectores
+(ver ingest_file()) pueden compartir la misma proyección.
+*/
+class CsvProjection
+{
+public:
+    CsvProjection(const vector<string> &header, const vector<string> &columns,
+                  MissingPolicy policy = MissingPolicy::skip, vector<double> imputed_values = {})
+        : policy(policy), imputed_values(move(imputed_values)), slot_of_field(header.size(), none)
+    {
+        if (this->imputed_values.empty())
+        {
+            this->imputed_values.assign(columns.size(), 0);
+        }
+        if (this->imputed_values.size() != columns.size())
+        {
+            throw invalid_argument("one imputed value per projected column is required");
+        }
+        for (size_t slot = 0; slot < columns.size(); slot++)
+        {
+            size_t field = 0;
+            while (field < header.size() && header[field] != columns[slot])
+                field++;
+            if (field == header.size())
+            {
+                throw invalid_argument("column not found in header: " + columns[slot]);
+            }
+            slot_of_field[field] = slot;
+            last_field = max(last_field, field);
+        }
+        names = columns;
+    }
+
+    size_t size() const { return names.size(); }
+
+    // Posición de la columna `name` en la salida de parse().
+    size_t slot_of(const string &name) const
+    {
+        for (size_t slot = 0; slot < names.size(); slot++)
+        {
+            if (names[slot] == name)
+                return slot;
+        }
+        throw invalid_argument("column not projected: " + name);
+    }
+
+    // Escribe size() valores en `values`, en el orden de `columns`.
+    RowStatus parse(string_view line, double *values) const
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        size_t imputed = 0;
+        size_t pos = 0, field = 0;
+        for (; field <= last_field && pos <= line.size(); field++)
+        {
+            string_view text = next_csv_field(line, pos);
+            size_t slot = slot_of_field[field];
+            if (slot == none)
+                continue;
+            if (!parse_value(text, values[slot]))
+            {
+                if (policy == MissingPolicy::skip)
+                    return RowStatus::skipped;
+                values[slot] = imputed_values[slot];
+                imputed++;
+            }
+        }
+        for (; field <= last_field; field++)
+        { // short line: the trailing projected columns are missing
+            size_t slot = slot_of_field[field];
+            if (slot == none)
+                continue;
+            if (policy == MissingPolicy::skip)
+                return RowStatus::skipped;
+            values[slot] = imputed_values[slot];
+            imputed++;
+        }
+        return imputed > 0 ? RowStatus::imputed : RowStatus::complete;
+    }
+
+private:
+    static constexpr size_t none = size_t(-1);
+
+    static bool parse_value(string_view text, double &value)
+    {
+        if (text.empty())
+            return false;
+        if (text == "negative")
+        {
+            value = 0;
+            return true;
+        }
+        if (text == "positive")
+        {
+            value = 1;
+            return true;
+        }
+        const char *first = text.data(), *last = text.data() + text.size();
+        if (*first == '+')
+            first++;
+        auto result = from_chars(first, last, value);
+        return result.ec == errc() && result.ptr == last;
+    }
+
+    MissingPolicy policy;
+    vector<double> imputed_values;
+    vector<size_t> slot_of_field;
+    size_t last_field{0};
+    vector<string> names;
+};
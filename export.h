@@ -0,0 +1,376 @@
+#pragma once
+#include "boundingbox.h"
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+/*
+BufferedWriter junta lo que se escribe en un búfer propio (1 MiB por
+defecto) y lo pasa al archivo con un solo fwrite() cuando se llena,
+en flush() o en el destructor. Con cout y endl cada línea es una
+escritura y un vaciado; aquí un volcado grande son unas pocas
+llamadas al sistema. Los números se escriben con to_chars(), sin
+pasar por locales ni flujos.
+
+Se puede abrir sobre una ruta (el archivo es propio y se cierra al
+final) o sobre un FILE* ya abierto, como stdout.
+*/
+class BufferedWriter
+{
+public:
+    explicit BufferedWriter(const string &path, size_t capacity = 1 << 20)
+        : path(path), file(fopen(path.c_str(), "wb")), owned(true), capacity(max<size_t>(capacity, 64))
+    {
+        if (!file)
+        {
+            throw invalid_argument("BufferedWriter: cannot open " + path);
+        }
+        buffer.reserve(this->capacity);
+    }
+
+    explicit BufferedWriter(FILE *file, size_t capacity = 1 << 20)
+        : path("stream"), file(file), capacity(max<size_t>(capacity, 64))
+    {
+        buffer.reserve(this->capacity);
+    }
+
+    ~BufferedWriter()
+    {
+        try
+        {
+            flush();
+        }
+        catch (const invalid_argument &)
+        { // nothing to report to from a destructor
+        }
+        if (owned)
+        {
+            fclose(file);
+        }
+    }
+
+    BufferedWriter(const BufferedWriter &) = delete;
+    BufferedWriter &operator=(const BufferedWriter &) = delete;
+
+    void write(const void *data, size_t size)
+    {
+        if (buffer.size() + size > capacity)
+        {
+            flush();
+        }
+        if (size >= capacity)
+        { // bigger than the buffer: straight to the file
+            write_out(data, size);
+            return;
+        }
+        const char *bytes = static_cast<const char *>(data);
+        buffer.insert(buffer.end(), bytes, bytes + size);
+    }
+
+    void put(char c)
+    {
+        if (buffer.size() >= capacity)
+        {
+            flush();
+        }
+        buffer.push_back(c);
+    }
+
+    void put(string_view text) { write(text.data(), text.size()); }
+
+    void number(double value)
+    {
+        char digits[32];
+        auto result = to_chars(digits, digits + sizeof(digits), value);
+        write(digits, size_t(result.ptr - digits));
+    }
+
+    void flush()
+    {
+        write_out(buffer.data(), buffer.size());
+        buffer.clear();
+        fflush(file);
+    }
+
+    size_t bytes_written{0}; //<bytes handed to the file
+    size_t writes{0};        //<fwrite() calls
+
+private:
+    void write_out(const void *data, size_t size)
+    {
+        if (size == 0)
+            return;
+        if (fwrite(data, 1, size, file) != size)
+        {
+            throw invalid_argument("BufferedWriter: cannot write " + path);
+        }
+        bytes_written += size;
+        writes++;
+    }
+
+    string path;
+    FILE *file;
+    bool owned{false};
+    size_t capacity;
+    vector<char> buffer;
+};
+
+/*
+export_format es el formato de un archivo exportado:
+
+- csv: una línea de encabezado con los nombres de las columnas y una
+línea por fila.
+- jsonl: JSON Lines, un objeto {"nombre": valor, ...} por línea. Los
+valores no finitos salen como null.
+- binary: el encabezado "RSTREXP1", la cantidad de columnas (uint64),
+cada nombre (largo uint32 y bytes) y después las filas como doubles
+seguidos, en el orden de bytes de la máquina. La cantidad de filas no
+se guarda: se lee hasta el final del archivo.
+*/
+enum class export_format
+{
+    csv,
+    jsonl,
+    binary
+};
+
+// Formato según la extensión del archivo (.csv, .jsonl o .bin).
+inline export_format export_format_of(const string &path)
+{
+    auto ends_with = [&path](const string &suffix)
+    {
+        return path.size() >= suffix.size() &&
+               path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    if (ends_with(".csv"))
+        return export_format::csv;
+    if (ends_with(".jsonl"))
+        return export_format::jsonl;
+    if (ends_with(".bin"))
+        return export_format::binary;
+    throw invalid_argument("export: unknown extension in " + path + " (use .csv, .jsonl or .bin)");
+}
+
+/*
+RecordExporter escribe filas de `columns` números con nombre en un
+BufferedWriter, en el formato elegido. El encabezado se escribe al
+construirlo y cada write() agrega una fila, así que se puede llamar
+desde el visitante de RStarTree::for_each_in_area() para exportar un
+resultado a medida que se encuentra (ver export_area()).
+*/
+template <size_t columns>
+class RecordExporter
+{
+public:
+    using Row = array<double, columns>;
+
+    RecordExporter(BufferedWriter &out, export_format format, const array<string, columns> &names)
+        : out(out), format(format)
+    {
+        if (format == export_format::csv)
+        {
+            for (size_t c = 0; c < columns; c++)
+            {
+                if (c > 0)
+                    out.put(',');
+                put_csv_name(names[c]);
+            }
+            out.put('\n');
+        }
+        else if (format == export_format::jsonl)
+        {
+            for (size_t c = 0; c < columns; c++)
+            {
+                keys[c] = c == 0 ? "{" : ",";
+                append_json_string(keys[c], names[c]);
+                keys[c] += ':';
+            }
+        }
+        else
+        {
+            uint64_t header[2] = {binary_magic, columns};
+            out.write(header, sizeof(header));
+            for (const string &name : names)
+            {
+                uint32_t length = uint32_t(name.size());
+                out.write(&length, sizeof(length));
+                out.put(name);
+            }
+        }
+    }
+
+    void write(const Row &row)
+    {
+        rows++;
+        if (format == export_format::binary)
+        {
+            out.write(row.data(), sizeof(row));
+            return;
+        }
+        for (size_t c = 0; c < columns; c++)
+        {
+            if (format == export_format::csv)
+            {
+                if (c > 0)
+                    out.put(',');
+                out.number(row[c]);
+            }
+            else
+            {
+                out.put(keys[c]);
+                if (isfinite(row[c]))
+                    out.number(row[c]);
+                else
+                    out.put("null");
+            }
+        }
+        out.put(format == export_format::csv ? "\n" : "}\n");
+    }
+
+    size_t rows{0}; //<rows written
+
+private:
+    static constexpr uint64_t binary_magic = 0x3150584552545352; // "RSTREXP1"
+
+    void put_csv_name(const string &name)
+    {
+        if (name.find_first_of(",\"\r\n") == string::npos)
+        {
+            out.put(name);
+            return;
+        }
+        out.put('"');
+        for (char c : name)
+        {
+            if (c == '"')
+                out.put('"');
+            out.put(c);
+        }
+        out.put('"');
+    }
+
+    static void append_json_string(string &text, const string &value)
+    {
+        text += '"';
+        for (char c : value)
+        {
+            if (c == '"' || c == '\\')
+            {
+                text += '\\';
+                text += c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", unsigned(c));
+                text += escaped;
+            }
+            else
+            {
+                text += c;
+            }
+        }
+        text += '"';
+    }
+
+    BufferedWriter &out;
+    export_format format;
+    array<string, columns> keys; //<'{"name":' or ',"name":' per column (jsonl)
+};
+
+/*
+export_results() escribe un resultado ya calculado (find_objects(),
+find_nearest(), ...) y export_area() hace la búsqueda con
+for_each_in_area() y escribe cada hoja apenas aparece, sin juntar el
+resultado. `fields_of` convierte el valor de una hoja en la fila.
+Ambas devuelven la cantidad de filas escritas.
+*/
+template <typename Results, size_t columns, typename Fields>
+size_t export_results(const Results &results, RecordExporter<columns> &exporter, Fields fields_of)
+{
+    size_t before = exporter.rows;
+    for (const auto &leaf : results)
+    {
+        exporter.write(fields_of(leaf.get_value()));
+    }
+    return exporter.rows - before;
+}
+
+template <typename Tree, size_t columns, typename Fields>
+size_t export_area(Tree &tree, const typename Tree::Area &area, RecordExporter<columns> &exporter,
+                   Fields fields_of)
+{
+    size_t before = exporter.rows;
+    tree.for_each_in_area(area, [&](const auto &leaf)
+                          { exporter.write(fields_of(leaf.get_value())); });
+    return exporter.rows - before;
+}
+
+// Edges of a leaf or node geometry as min_0, max_0, min_1, ...
+template <size_t dimensions, typename cost_type>
+void copy_edges(const RStarBoundingBox<dimensions, cost_type> &box, double *edges)
+{
+    for (size_t axis = 0; axis < dimensions; axis++)
+    {
+        edges[2 * axis] = box.min_edges[axis];
+        edges[2 * axis + 1] = box.max_edges[axis];
+    }
+}
+
+template <size_t dimensions, typename cost_type>
+void copy_edges(const RStarPoint<dimensions, cost_type> &point, double *edges)
+{
+    for (size_t axis = 0; axis < dimensions; axis++)
+    {
+        edges[2 * axis] = edges[2 * axis + 1] = point.coords[axis];
+    }
+}
+
+/*
+export_tree() vuelca la estructura del árbol con RStarTree::walk_tree():
+una fila por nodo y una por valor, en preorden. Las columnas son
+leaf (0 nodo, 1 hoja), depth, children (hijos del nodo, 0 en las
+hojas) y min_i, max_i por eje (en una hoja puntual min_i = max_i).
+Devuelve la cantidad de filas.
+*/
+template <typename Tree>
+size_t export_tree(Tree &tree, BufferedWriter &out, export_format format)
+{
+    constexpr size_t dimensions = tuple_size<decltype(Tree::Point::coords)>::value;
+    constexpr size_t columns = 3 + 2 * dimensions;
+    array<string, columns> names{"leaf", "depth", "children"};
+    for (size_t axis = 0; axis < dimensions; axis++)
+    {
+        names[3 + 2 * axis] = "min_" + to_string(axis);
+        names[4 + 2 * axis] = "max_" + to_string(axis);
+    }
+    RecordExporter<columns> exporter(out, format, names);
+    array<double, columns> row;
+    tree.walk_tree(
+        [&](size_t depth, const typename Tree::Area &box, size_t children)
+        {
+            row[0] = 0;
+            row[1] = double(depth);
+            row[2] = double(children);
+            copy_edges(box, row.data() + 3);
+            exporter.write(row);
+        },
+        [&](size_t depth, const auto &leaf)
+        {
+            row[0] = 1;
+            row[1] = double(depth);
+            row[2] = 0;
+            copy_edges(leaf.get_box(), row.data() + 3);
+            exporter.write(row);
+        });
+    return exporter.rows;
+}
@@ -0,0 +1,455 @@
+#pragma once
+#include "rstartree.h"
+#include "normalizer.h"
+#include "server.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/*
+Las dimensiones y las capacidades de nodo que se compilan de antemano.
+make_record_index() elige entre todas las combinaciones: de
+index_min_dimensions a index_max_dimensions columnas y una de las
+capacidades máximas de index_capacities (la mínima es la mitad). Cada
+combinación es un RStarTree propio, con los bucles por eje
+desenrollados para su cantidad de dimensiones; agregar una capacidad
+multiplica el tiempo de compilación de quien incluya este archivo.
+*/
+constexpr size_t index_min_dimensions = 2;
+constexpr size_t index_max_dimensions = 11;
+constexpr array<size_t, 3> index_capacities{8, 20, 32};
+
+/*
+IndexSpec es la configuración de un índice elegida al ejecutar:
+
+- columns: las columnas del registro que se indexan, en orden (cada
+una es una posición en el vector de campos de make_record_index()).
+- max_children: la capacidad máxima de los nodos, una de
+index_capacities.
+- mode: la normalización de las columnas (ver FeatureNormalizer).
+- reinsert_fraction: el mismo parámetro del árbol, la fracción de los
+hijos de un nodo desbordado que se reinserta.
+*/
+struct IndexSpec
+{
+    vector<size_t> columns;
+    size_t max_children{20};
+    normalization mode{normalization::zscore};
+    double reinsert_fraction{0.3};
+};
+
+/*
+parse_index_spec() arma un IndexSpec a partir de texto, por ejemplo de
+la línea de comandos: `columns` es una lista separada por comas de
+nombres de `names` o de posiciones (desde 0), y `capacity` la
+capacidad máxima de los nodos. Lanza invalid_argument si una columna
+no existe o está repetida.
+*/
+inline IndexSpec parse_index_spec(const string &columns, const string &capacity,
+                                  const vector<string> &names)
+{
+    IndexSpec spec;
+    size_t start = 0;
+    while (start <= columns.size())
+    {
+        size_t end = min(columns.find(',', start), columns.size());
+        string token = columns.substr(start, end - start);
+        size_t column = find(names.begin(), names.end(), token) - names.begin();
+        if (column == names.size() && !token.empty() &&
+            token.find_first_not_of("0123456789") == string::npos)
+        {
+            column = stoul(token);
+        }
+        if (column >= names.size())
+        {
+            throw invalid_argument("index: unknown column '" + token + "'");
+        }
+        if (find(spec.columns.begin(), spec.columns.end(), column) != spec.columns.end())
+        {
+            throw invalid_argument("index: repeated column '" + token + "'");
+        }
+        spec.columns.push_back(column);
+        start = end + 1;
+    }
+    if (capacity.empty() || capacity.find_first_not_of("0123456789") != string::npos)
+    {
+        throw invalid_argument("index: bad capacity '" + capacity + "'");
+    }
+    spec.max_children = stoul(capacity);
+    return spec;
+}
+
+/*
+write_index_spec() guarda un IndexSpec en un archivo de texto, una
+clave por línea, y read_index_spec() lo lee:
+
+    columns=a,c,d
+    capacity=20
+    reinsert=0.3
+    normalization=zscore
+
+Así la configuración que elige tune_index() (autotune.h) se pasa a
+make_record_index() sin recompilar. Al leer, las claves que faltan
+conservan el valor por defecto y una clave desconocida lanza
+invalid_argument.
+*/
+inline void write_index_spec(const string &path, const IndexSpec &spec, const vector<string> &names)
+{
+    ofstream out(path);
+    if (!out)
+    {
+        throw invalid_argument("write_index_spec: cannot open " + path);
+    }
+    out << "columns=";
+    for (size_t i = 0; i < spec.columns.size(); i++)
+    {
+        out << (i > 0 ? "," : "") << names.at(spec.columns[i]);
+    }
+    out << "\ncapacity=" << spec.max_children << "\nreinsert=" << spec.reinsert_fraction
+        << "\nnormalization="
+        << (spec.mode == normalization::zscore ? "zscore" : "minmax") << '\n';
+}
+
+inline IndexSpec read_index_spec(const string &path, const vector<string> &names)
+{
+    ifstream in(path);
+    if (!in)
+    {
+        throw invalid_argument("read_index_spec: cannot open " + path);
+    }
+    string line, columns, capacity = "20";
+    IndexSpec read;
+    while (getline(in, line))
+    {
+        size_t equals = line.find('=');
+        string key = line.substr(0, equals);
+        string value = equals == string::npos ? "" : line.substr(equals + 1);
+        if (key.empty())
+            continue;
+        if (key == "columns")
+            columns = value;
+        else if (key == "capacity")
+            capacity = value;
+        else if (key == "reinsert")
+            read.reinsert_fraction = stod(value);
+        else if (key == "normalization" && (value == "zscore" || value == "minmax"))
+            read.mode = value == "zscore" ? normalization::zscore : normalization::minmax;
+        else
+            throw invalid_argument("read_index_spec: bad line '" + line + "' in " + path);
+    }
+    IndexSpec spec = parse_index_spec(columns, capacity, names);
+    spec.mode = read.mode;
+    spec.reinsert_fraction = read.reinsert_fraction;
+    return spec;
+}
+
+// Resumen de TreeStats que no depende de la especialización.
+struct IndexStats
+{
+    size_t height{0};
+    size_t nodes{0};
+    size_t leaf_nodes{0};
+    size_t values{0};
+    double total_overlap{0};
+    double coverage{0};
+    size_t node_bytes{0};
+};
+
+/*
+RecordIndex es la interfaz común de los índices que crea
+make_record_index(). Los valores de las consultas van en las unidades
+originales de las columnas elegidas, en el orden de IndexSpec::columns,
+y el índice los normaliza como en la carga; en un rango, ±infinito
+deja el eje sin límite. Las distancias se miden en el espacio
+normalizado.
+
+La llamada virtual se paga una vez por operación: la búsqueda en sí
+corre dentro del RStarTree especializado.
+
+- build() observa todos los registros para la normalización, los
+inserta y activa el planificador de búsquedas (enable_planner()).
+- enable_key_index() activa el índice por clave del árbol.
+- serve() y serve_unix_socket() atienden el protocolo de QueryServer
+con las columnas elegidas como características; `new_record` da el
+registro base de cada inserción (por ejemplo con un id nuevo) y el
+índice le copia los valores.
+*/
+template <typename Record>
+class RecordIndex
+{
+public:
+    using Values = vector<double>;
+
+    virtual ~RecordIndex() = default;
+
+    virtual size_t dimensions() const = 0;
+    virtual size_t max_children() const = 0;
+    virtual size_t size() const = 0;
+    virtual IndexStats stats() const = 0;
+
+    virtual void build(const vector<Record> &records) = 0;
+    virtual void enable_key_index(function<uint64_t(const Record &)> key_of) = 0;
+    virtual void insert(const Record &record) = 0;
+
+    virtual vector<Record> find_in_range(const Values &lo, const Values &hi) = 0;
+    virtual size_t count_in_range(const Values &lo, const Values &hi) = 0;
+    virtual size_t delete_in_range(const Values &lo, const Values &hi) = 0;
+    virtual vector<pair<double, Record>> find_nearest(const Values &at, size_t k) = 0;
+    virtual vector<pair<double, Record>> find_within(const Values &at, double radius) = 0;
+
+    virtual void serve(istream &in, ostream &out, function<Record()> new_record) = 0;
+#ifndef _WIN32
+    virtual void serve_unix_socket(const string &path, function<Record()> new_record) = 0;
+#endif
+};
+
+/*
+SpecializedIndex implementa RecordIndex sobre un
+RStarTree<Record, dims, max_children / 2, max_children> con hojas
+puntuales. Convierte los vectores de la interfaz en Features de
+tamaño fijo y delega todo al árbol.
+*/
+template <typename Record, size_t dims, size_t max_children_>
+class SpecializedIndex : public RecordIndex<Record>
+{
+public:
+    using Tree = RStarTree<Record, dims, max_children_ / 2, max_children_, double, true>;
+    using Normalizer = FeatureNormalizer<dims>;
+    using Features = typename Normalizer::Features;
+    using Values = typename RecordIndex<Record>::Values;
+
+    SpecializedIndex(const IndexSpec &spec, const vector<double Record::*> &fields)
+        : normalizer(spec.mode)
+    {
+        for (size_t axis = 0; axis < dims; axis++)
+        {
+            columns[axis] = fields.at(spec.columns[axis]);
+        }
+        tree.reinsert_fraction = spec.reinsert_fraction;
+        // With few columns many records share a point: keep them in one leaf
+        tree.bucket_duplicates = true;
+    }
+
+    size_t dimensions() const override { return dims; }
+    size_t max_children() const override { return max_children_; }
+    size_t size() const override { return tree.size_; }
+
+    IndexStats stats() const override
+    {
+        auto full = tree.stats();
+        return {full.height, full.nodes, full.leaf_nodes, full.values,
+                full.total_overlap, full.coverage, full.node_bytes};
+    }
+
+    void build(const vector<Record> &records) override
+    {
+        for (const Record &record : records)
+        {
+            normalizer.observe(features_of(record));
+        }
+        for (const Record &record : records)
+        {
+            tree.insert(record, normalizer.point(features_of(record)));
+        }
+        tree.enable_planner();
+    }
+
+    void enable_key_index(function<uint64_t(const Record &)> key_of) override
+    {
+        tree.enable_key_index(move(key_of));
+    }
+
+    void insert(const Record &record) override
+    {
+        tree.insert(record, normalizer.point(features_of(record)));
+    }
+
+    vector<Record> find_in_range(const Values &lo, const Values &hi) override
+    {
+        vector<Record> records;
+        for (auto &leaf : tree.find_objects_in_area(area(lo, hi)))
+        {
+            records.push_back(leaf.get_value());
+        }
+        return records;
+    }
+
+    size_t count_in_range(const Values &lo, const Values &hi) override
+    {
+        size_t count = 0;
+        tree.for_each_in_area(area(lo, hi), [&count](const auto &)
+                              { count++; });
+        return count;
+    }
+
+    size_t delete_in_range(const Values &lo, const Values &hi) override
+    {
+        size_t before = tree.size_;
+        tree.delete_objects_in_area(area(lo, hi));
+        return before - tree.size_;
+    }
+
+    vector<pair<double, Record>> find_nearest(const Values &at, size_t k) override
+    {
+        auto point = normalizer.point(features(at));
+        return with_distances(point, tree.find_nearest(point, k));
+    }
+
+    vector<pair<double, Record>> find_within(const Values &at, double radius) override
+    {
+        auto point = normalizer.point(features(at));
+        return with_distances(point, tree.find_objects_within_distance(point, radius, Tree::unit_weights(), true));
+    }
+
+    void serve(istream &in, ostream &out, function<Record()> new_record) override
+    {
+        auto server = make_server(move(new_record));
+        serve_stream(server, in, out);
+    }
+
+#ifndef _WIN32
+    void serve_unix_socket(const string &path, function<Record()> new_record) override
+    {
+        auto server = make_server(move(new_record));
+        ::serve_unix_socket(server, path);
+    }
+#endif
+
+    Tree tree;
+    Normalizer normalizer;
+
+private:
+    Features features_of(const Record &record) const
+    {
+        Features values;
+        for (size_t axis = 0; axis < dims; axis++)
+        {
+            values[axis] = record.*columns[axis];
+        }
+        return values;
+    }
+
+    static Features features(const Values &values)
+    {
+        if (values.size() != dims)
+        {
+            throw invalid_argument("index: expected " + to_string(dims) + " values, got " +
+                                   to_string(values.size()));
+        }
+        Features result;
+        copy(values.begin(), values.end(), result.begin());
+        return result;
+    }
+
+    typename Tree::Area area(const Values &lo, const Values &hi) const
+    {
+        return normalizer.query_box(features(lo), features(hi));
+    }
+
+    static vector<pair<double, Record>> with_distances(const typename Tree::Point &point,
+                                                       const vector<typename Tree::LeafWithConstBox> &leafs)
+    {
+        vector<pair<double, Record>> results;
+        results.reserve(leafs.size());
+        for (auto &leaf : leafs)
+        {
+            double sum = 0;
+            for (size_t axis = 0; axis < dims; axis++)
+            {
+                double d = leaf.get_box().coords[axis] - point.coords[axis];
+                sum += d * d;
+            }
+            results.push_back({sqrt(sum), leaf.get_value()});
+        }
+        return results;
+    }
+
+    QueryServer<Tree, Normalizer, Record> make_server(function<Record()> new_record)
+    {
+        return QueryServer<Tree, Normalizer, Record>(
+            tree, normalizer, [this](const Record &record)
+            { return features_of(record); },
+            [this, new_record = move(new_record)](const Features &values)
+            {
+                Record record = new_record();
+                for (size_t axis = 0; axis < dims; axis++)
+                {
+                    record.*columns[axis] = values[axis];
+                }
+                return record;
+            });
+    }
+
+    array<double Record::*, dims> columns;
+};
+
+// Tabla de fábricas: una fila por dimensión y una columna por capacidad.
+template <typename Record>
+using IndexMaker = unique_ptr<RecordIndex<Record>> (*)(const IndexSpec &, const vector<double Record::*> &);
+
+template <typename Record, size_t dims, size_t max_children>
+unique_ptr<RecordIndex<Record>> make_specialized_index(const IndexSpec &spec,
+                                                       const vector<double Record::*> &fields)
+{
+    return make_unique<SpecializedIndex<Record, dims, max_children>>(spec, fields);
+}
+
+template <typename Record, size_t dims, size_t... capacity>
+constexpr array<IndexMaker<Record>, sizeof...(capacity)> index_makers_for(index_sequence<capacity...>)
+{
+    return {&make_specialized_index<Record, dims, index_capacities[capacity]>...};
+}
+
+template <typename Record, size_t... dims>
+constexpr auto index_maker_table(index_sequence<dims...>)
+{
+    return array<array<IndexMaker<Record>, index_capacities.size()>, sizeof...(dims)>{
+        index_makers_for<Record, index_min_dimensions + dims>(make_index_sequence<index_capacities.size()>())...};
+}
+
+/*
+make_record_index() crea el índice que pide `spec` sobre registros
+cuyas columnas numéricas son `fields`. Lanza invalid_argument si la
+cantidad de columnas o la capacidad no están entre las compiladas.
+*/
+template <typename Record>
+unique_ptr<RecordIndex<Record>> make_record_index(const IndexSpec &spec,
+                                                  const vector<double Record::*> &fields)
+{
+    static constexpr auto table =
+        index_maker_table<Record>(make_index_sequence<index_max_dimensions - index_min_dimensions + 1>());
+    size_t dims = spec.columns.size();
+    if (dims < index_min_dimensions || dims > index_max_dimensions)
+    {
+        throw invalid_argument("make_record_index: " + to_string(dims) + " columns, expected " +
+                               to_string(index_min_dimensions) + " to " + to_string(index_max_dimensions));
+    }
+    for (size_t column : spec.columns)
+    {
+        if (column >= fields.size())
+        {
+            throw invalid_argument("make_record_index: column " + to_string(column) + " out of range");
+        }
+    }
+    size_t slot = find(index_capacities.begin(), index_capacities.end(), spec.max_children) -
+                  index_capacities.begin();
+    if (slot == index_capacities.size())
+    {
+        throw invalid_argument("make_record_index: capacity " + to_string(spec.max_children) +
+                               " is not compiled in");
+    }
+    return table[dims - index_min_dimensions][slot](spec, fields);
+}
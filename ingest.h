@@ -0,0 +1,268 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*
+BoundedQueue es una cola circular acotada sin locks para varios
+productores y un consumidor (MPSC; también sirve como SPSC). Cada celda
+lleva un número de secuencia que indica si está libre para el productor
+de esa vuelta o lista para el consumidor, así push y pop solo usan
+operaciones atómicas (algoritmo de D. Vyukov). La capacidad se redondea
+a una potencia de dos.
+
+try_push() devuelve false si la cola está llena y try_pop() si está
+vacía; quien llama decide cómo esperar, y esas esperas son las que
+cuentan los contadores de IngestStats.
+*/
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size *= 2;
+        }
+        cells = vector<Cell>(size);
+        mask = size - 1;
+        for (size_t i = 0; i < size; i++)
+        {
+            cells[i].sequence.store(i, memory_order_relaxed);
+        }
+    }
+
+    bool try_push(T &value)
+    {
+        size_t pos = enqueue_pos.load(memory_order_relaxed);
+        while (true)
+        {
+            Cell &cell = cells[pos & mask];
+            size_t sequence = cell.sequence.load(memory_order_acquire);
+            if (sequence == pos)
+            {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                {
+                    cell.value = move(value);
+                    cell.sequence.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            }
+            else if (sequence < pos)
+            { // full: the consumer has not freed this cell yet
+                return false;
+            }
+            else
+            {
+                pos = enqueue_pos.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T &value)
+    {
+        size_t pos = dequeue_pos.load(memory_order_relaxed);
+        Cell &cell = cells[pos & mask];
+        if (cell.sequence.load(memory_order_acquire) != pos + 1)
+        { // empty
+            return false;
+        }
+        dequeue_pos.store(pos + 1, memory_order_relaxed);
+        value = move(cell.value);
+        cell.sequence.store(pos + mask + 1, memory_order_release);
+        return true;
+    }
+
+private:
+    struct Cell
+    {
+        atomic<size_t> sequence;
+        T value;
+    };
+
+    vector<Cell> cells;
+    size_t mask{0};
+    alignas(64) atomic<size_t> enqueue_pos{0};
+    alignas(64) atomic<size_t> dequeue_pos{0};
+};
+
+/*
+IngestStats resume una corrida de ingest_file():
+
+- records, batches: registros y lotes que llegaron al consumidor.
+- parse_seconds: tiempo sumado de todos los hilos lectores leyendo y
+parseando líneas.
+- sink_seconds: tiempo del consumidor dentro de `sink` (insertando).
+- producer_stalls: veces que un lector encontró la cola llena y tuvo
+que esperar (contrapresión: el consumidor es el cuello de botella).
+- consumer_stalls: veces que el consumidor encontró la cola vacía
+(los lectores son el cuello de botella).
+- total_seconds: duración total de la ingesta.
+
+parse_rate() y sink_rate() dan los registros por segundo de cada
+etapa, tomando para los lectores el tiempo promedio por hilo.
+*/
+struct IngestStats
+{
+    size_t parsers{0};
+    size_t records{0};
+    size_t batches{0};
+    size_t producer_stalls{0};
+    size_t consumer_stalls{0};
+    double parse_seconds{0};
+    double sink_seconds{0};
+    double total_seconds{0};
+
+    double parse_rate() const
+    {
+        return parse_seconds > 0 ? records / (parse_seconds / parsers) : 0;
+    }
+    double sink_rate() const
+    {
+        return sink_seconds > 0 ? records / sink_seconds : 0;
+    }
+};
+
+/*
+ingest_file() es la etapa de ingesta en paralelo de un archivo de texto
+con un registro por línea:
+
+* El archivo se divide en `parsers` tramos de bytes, cortados en
+límites de línea, y cada tramo lo lee y parsea un hilo propio con
+`parse(line)`. La primera línea se descarta si `header` es true.
+* Los lectores agrupan los registros en lotes de `batch_size` y los
+empujan a una BoundedQueue de `queue_batches` lotes.
+* El hilo que llama es el único consumidor: toma los lotes y llama a
+`sink(batch)`. Por eso `sink` puede modificar el árbol sin locks.
+
+El orden de los registros se conserva dentro de cada tramo, pero los
+tramos se intercalan.
+*/
+template <typename Record, typename Parse, typename Sink>
+IngestStats ingest_file(const string &path, bool header, unsigned parsers, Parse parse,
+                        Sink sink, size_t batch_size = 256, size_t queue_batches = 64)
+{
+    using clock = chrono::steady_clock;
+    auto seconds_since = [](clock::time_point start)
+    { return chrono::duration<double>(clock::now() - start).count(); };
+    auto start = clock::now();
+
+    IngestStats stats;
+    stats.parsers = max(parsers, 1u);
+    ifstream probe(path, ios::binary | ios::ate);
+    size_t file_size = probe ? size_t(probe.tellg()) : 0;
+
+    BoundedQueue<vector<Record>> queue(queue_batches);
+    atomic<size_t> finished{0}, producer_stalls{0};
+    vector<double> parse_seconds(stats.parsers, 0);
+
+    auto reader = [&](size_t part)
+    {
+        size_t begin = file_size * part / stats.parsers;
+        size_t end = file_size * (part + 1) / stats.parsers;
+        ifstream file(path, ios::binary);
+        string line;
+        size_t pos = 0;
+        if (begin > 0)
+        { // the line that crosses `begin` belongs to the previous part
+            file.seekg(begin - 1);
+            getline(file, line);
+            pos = begin + line.size();
+        }
+        else if (header)
+        {
+            getline(file, line);
+            pos = line.size() + 1;
+        }
+        vector<Record> batch;
+        batch.reserve(batch_size);
+        auto flush = [&]()
+        {
+            bool stalled = false;
+            while (!queue.try_push(batch))
+            {
+                stalled = true;
+                this_thread::yield();
+            }
+            producer_stalls += stalled;
+            batch.clear();
+            batch.reserve(batch_size);
+        };
+        auto parse_start = clock::now();
+        while (pos < end && getline(file, line))
+        {
+            pos += line.size() + 1;
+            if (line.empty() || line == "\r")
+                continue;
+            batch.push_back(parse(line));
+            if (batch.size() == batch_size)
+            {
+                parse_seconds[part] += seconds_since(parse_start);
+                flush();
+                parse_start = clock::now();
+            }
+        }
+        parse_seconds[part] += seconds_since(parse_start);
+        if (!batch.empty())
+        {
+            flush();
+        }
+        finished++;
+    };
+
+    vector<thread> threads;
+    for (size_t part = 0; part < stats.parsers; part++)
+    {
+        threads.emplace_back(reader, part);
+    }
+    vector<Record> batch;
+    auto consume = [&]()
+    {
+        stats.records += batch.size();
+        stats.batches++;
+        auto sink_start = clock::now();
+        sink(batch);
+        stats.sink_seconds += seconds_since(sink_start);
+    };
+    bool waiting = false;
+    while (true)
+    {
+        if (queue.try_pop(batch))
+        {
+            stats.consumer_stalls += waiting;
+            waiting = false;
+            consume();
+            continue;
+        }
+        if (finished == stats.parsers)
+        { // every push is visible once its reader counted itself finished
+            while (queue.try_pop(batch))
+            {
+                consume();
+            }
+            break;
+        }
+        waiting = true;
+        this_thread::yield();
+    }
+    for (thread &t : threads)
+    {
+        t.join();
+    }
+    stats.producer_stalls = producer_stalls;
+    for (double seconds : parse_seconds)
+    {
+        stats.parse_seconds += seconds;
+    }
+    stats.total_seconds = seconds_since(start);
+    return stats;
+}
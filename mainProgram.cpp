@@ -1,108 +1,272 @@
 #include "rstartree.h"
+#include "normalizer.h"
+#include "paciente.h"
+#include "ingest.h"
+#include "csvloader.h"
+#include "server.h"
+#include "export.h"
+#include "indexfactory.h"
+#include "autotune.h"
+#include <array>
 #include <iostream>
 #include <fstream>
+#include <limits>
 #include <sstream>
+#include <thread>
 #include <vector>
 
 using namespace std;
 
-struct Paciente
-{
-    double a, b, c, d, e, f, g, h, i, j, k;
-};
+using Caracteristicas = array<double, columnasPaciente>;
 
-std::ostream& operator<<(std::ostream& out, const Paciente& point) 
+// Se indexan las 11 características del paciente.
+Caracteristicas caracteristicasIndice(const Paciente &paciente)
 {
-    out << "(" << point.a << ", " << point.b << ", " << point.c
-    << "(" << point.d << ", " << point.e << ", " << point.f 
-    << "(" << point.g << ", " << point.h << ", " << point.i 
-    << "(" << point.j << ", " << point.k << ")";
-    return out;
+    Caracteristicas valores;
+    for (size_t columna = 0; columna < columnasPaciente; columna++)
+    {
+        valores[columna] = paciente.*camposPaciente[columna];
+    }
+    return valores;
 }
 
-// Función para crear una caja tridimensional
-RStarBoundingBox<3> createBox3D(int a, int b, int c, int w, int h, int d) 
+// Rango de consulta sobre a (examen), b (edad) y c (hematocrito); las
+// demás columnas quedan sin restricción.
+pair<Caracteristicas, Caracteristicas> rangoConsulta(const array<double, 3> &desde,
+                                                     const array<double, 3> &hasta)
 {
-    RStarBoundingBox<3> box;
-    box.min_edges[0] = a;
-    box.min_edges[1] = b;
-    box.min_edges[2] = c;
-    box.max_edges[0] = a + w;
-    box.max_edges[1] = b + h;
-    box.max_edges[2] = c + d;
-    return box;
+    Caracteristicas lo, hi;
+    lo.fill(-numeric_limits<double>::infinity());
+    hi.fill(numeric_limits<double>::infinity());
+    copy(desde.begin(), desde.end(), lo.begin());
+    copy(hasta.begin(), hasta.end(), hi.begin());
+    return {lo, hi};
 }
 
-// Función para parsear una línea del archivo CSV b obtener un punto 3D
-Paciente leerCSVLine(const string& line) 
+// Inversa de caracteristicasIndice(): el paciente con esas características.
+Paciente pacienteDe(const Caracteristicas &valores)
 {
-    Paciente caractPaciente;
-    stringstream ss(line);
-    string token;
-    getline(ss, token, ',');
-    caractPaciente.a = stod(token);
-    getline(ss, token, ',');
-    caractPaciente.b = stod(token);
-    getline(ss, token, ',');
-    caractPaciente.c = stod(token);
-    getline(ss, token, ',');
-    caractPaciente.d = stod(token);
-    getline(ss, token, ',');
-    caractPaciente.e = stod(token);
-    getline(ss, token, ',');
-    caractPaciente.f = stod(token);
-    getline(ss, token, ',');
-    caractPaciente.g = stod(token);
-    getline(ss, token, ',');
-    caractPaciente.h = stod(token);
-    getline(ss, token, ',');
-    caractPaciente.i = stod(token);
-    getline(ss, token, ',');
-    caractPaciente.j = stod(token);
-    getline(ss, token, ',');
-    caractPaciente.k = stod(token);
-    return caractPaciente;
+    Paciente paciente;
+    for (size_t columna = 0; columna < columnasPaciente; columna++)
+    {
+        paciente.*camposPaciente[columna] = valores[columna];
+    }
+    return paciente;
 }
 
-int main() 
+/*
+Uso: mainProgram                  carga, borra, consulta e imprime (demo)
+     mainProgram --serve          carga y atiende órdenes por stdin/stdout
+     mainProgram --serve SOCKET   carga y atiende órdenes en un socket Unix
+     mainProgram --export ARCHIVO exporta todos los pacientes
+     mainProgram --dump ARCHIVO   vuelca la estructura del árbol
+     mainProgram --index COLUMNAS CAPACIDAD [--serve [SOCKET]]
+                                  indexa solo COLUMNAS (letras a..k separadas
+                                  por comas, ver paciente.h) con nodos de
+                                  CAPACIDAD hijos y muestra el árbol o atiende
+                                  órdenes con esas columnas
+     mainProgram --index-file CONFIG [--serve [SOCKET]]
+                                  lo mismo con la configuración guardada en
+                                  CONFIG (ver write_index_spec())
+     mainProgram --tune COLUMNAS CARGA [CONFIG]
+                                  prueba capacidades y fracciones de
+                                  reinserción con la carga de órdenes CARGA,
+                                  muestra los tiempos y guarda la mejor
+                                  configuración en CONFIG
+El protocolo de órdenes está descrito en server.h; el formato de
+exportación sale de la extensión (.csv, .jsonl o .bin, ver export.h).
+Las combinaciones de columnas y capacidades admitidas están en
+indexfactory.h y la búsqueda de la mejor en autotune.h.
+*/
+int main(int argc, char **argv) 
 {
-    // Crear un árbol R* para puntos 3D
-    RStarTree<Paciente, 3, 10, 20> rstarTree; // Dimensiones: 3, Min Child: 10, Max Child: 20
+    // Crear un árbol R* para puntos de 11 dimensiones, con hojas puntuales
+    RStarTree<Paciente, columnasPaciente, 10, 20, double, true> rstarTree; // Dimensiones: 11, Min Child: 10, Max Child: 20
+    // Muchos pacientes comparten todas las características: se agrupan en una hoja
+    rstarTree.bucket_duplicates = true;
 
-    ifstream file("./Files/covid_DB_datos_importantes_completos_double.csv");
-    string line;
-    getline(file, line);
+    // Una sola pasada por el archivo crudo: hilos lectores proyectan las
+    // columnas de Files/importantColumns.csv, descartan las filas
+    // incompletas y este hilo acumula las estadísticas de las columnas indexadas.
+    CsvProjection proyeccion(read_csv_names("./Files/dataColumn.csv"),
+                             read_csv_names("./Files/importantColumns.csv"),
+                             MissingPolicy::skip);
+    array<size_t, columnasPaciente> posicion;
+    for (size_t columna = 0; columna < columnasPaciente; columna++) {
+        posicion[columna] = proyeccion.slot_of(columnasCovid[columna]);
+    }
+    auto leerFilaCruda = [&](const string &line) {
+        thread_local vector<double> valores;
+        valores.resize(proyeccion.size());
+        pair<RowStatus, Paciente> fila;
+        fila.first = proyeccion.parse(line, valores.data());
+        size_t inicio = 0; // Patient ID, primera columna
+        fila.second.id = idPaciente(next_csv_field(line, inicio));
+        for (size_t columna = 0; fila.first != RowStatus::skipped && columna < columnasPaciente; columna++) {
+            fila.second.*camposPaciente[columna] = valores[posicion[columna]];
+        }
+        return fila;
+    };
+    vector<Paciente> pacientes;
+    FeatureNormalizer<columnasPaciente> normalizador(normalization::zscore);
+    ingest_file<pair<RowStatus, Paciente>>("./Files/covid_DB.csv", false,
+                          max(thread::hardware_concurrency(), 1u), leerFilaCruda,
+                          [&](const vector<pair<RowStatus, Paciente>> &lote) {
+                              for (const auto &fila : lote) {
+                                  if (fila.first == RowStatus::skipped)
+                                      continue;
+                                  normalizador.observe(caracteristicasIndice(fila.second));
+                                  pacientes.push_back(fila.second);
+                              }
+                          });
 
-    while (getline(file, line)) {
-        //Parsear la línea b obtener un punto 3D
-        Paciente caracteristicaPaciente = leerCSVLine(line);
+    // Los pacientes que llegan por el servidor reciben ids nuevos,
+    // mayores que los ids hexadecimales del archivo
+    uint64_t siguienteId = 1;
+    for (const Paciente &paciente : pacientes) {
+        if (paciente.id < (uint64_t(1) << 63))
+            siguienteId = max(siguienteId, paciente.id + 1);
+    }
+    auto pacienteNuevo = [&siguienteId]() {
+        Paciente paciente{};
+        paciente.id = siguienteId++;
+        return paciente;
+    };
 
-        //Crear la caja tridimensional alrededor del punto
-        //Solo sumamos 1
-        RStarBoundingBox<3> box = createBox3D(caracteristicaPaciente.a, caracteristicaPaciente.b, caracteristicaPaciente.c, 1, 1, 1);
+    string modo = argc > 1 ? argv[1] : "";
+    if ((modo == "--index" && argc > 3) || (modo == "--index-file" && argc > 2) ||
+        (modo == "--tune" && argc > 3))
+    {
+        // Columnas y capacidad elegidas al ejecutar, sin recompilar
+        vector<string> nombres = {"a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k"};
+        vector<double Paciente::*> campos(begin(camposPaciente), end(camposPaciente));
+        try {
+            if (modo == "--tune")
+            {
+                ifstream archivoCarga(argv[3]);
+                if (!archivoCarga)
+                    throw invalid_argument(string("cannot open ") + argv[3]);
+                stringstream carga;
+                carga << archivoCarga.rdbuf();
+                auto resultados = tune_index<Paciente>(pacientes, campos, parse_index_spec(argv[2], "20", nombres),
+                                                       carga.str(), TuningOptions(), pacienteNuevo);
+                print_tuning(resultados, cout);
+                if (argc > 4)
+                    write_index_spec(argv[4], resultados.front().spec, nombres);
+                return 0;
+            }
+            int siguiente = modo == "--index" ? 4 : 3;
+            IndexSpec configuracion = modo == "--index" ? parse_index_spec(argv[2], argv[3], nombres)
+                                                         : read_index_spec(argv[2], nombres);
+            auto indice = make_record_index<Paciente>(configuracion, campos);
+            indice->build(pacientes);
+            indice->enable_key_index([](const Paciente &paciente) { return paciente.id; });
+            if (argc > siguiente && string(argv[siguiente]) == "--serve")
+            {
+#ifndef _WIN32
+                if (argc > siguiente + 1)
+                {
+                    indice->serve_unix_socket(argv[siguiente + 1], pacienteNuevo);
+                    return 0;
+                }
+#endif
+                ios::sync_with_stdio(false);
+                indice->serve(cin, cout, pacienteNuevo);
+                return 0;
+            }
+            IndexStats resumen = indice->stats();
+            cout << "dimensiones=" << indice->dimensions() << " capacidad=" << indice->max_children()
+                 << " reinsercion=" << configuracion.reinsert_fraction
+                 << " pacientes=" << indice->size() << " altura=" << resumen.height
+                 << " nodos=" << resumen.nodes << " nodos_hoja=" << resumen.leaf_nodes
+                 << " solapamiento=" << resumen.total_overlap << " cobertura=" << resumen.coverage << '\n';
+        } catch (const invalid_argument &error) {
+            cerr << error.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
 
-        rstarTree.insert(caracteristicaPaciente, box);
+    // Cada paciente se indexa como un punto en el espacio normalizado. La
+    // normalización necesita todas las filas, así que los pacientes se
+    // acumulan durante la lectura y el árbol se construye de una vez (STR)
+    vector<pair<Paciente, decltype(rstarTree)::Point>> registros;
+    registros.reserve(pacientes.size());
+    for (const Paciente &caracteristicaPaciente : pacientes) {
+        registros.emplace_back(caracteristicaPaciente,
+                               normalizador.point(caracteristicasIndice(caracteristicaPaciente)));
     }
+    vector<Paciente>().swap(pacientes);
+    rstarTree.bulk_load(move(registros));
+    // Índice por Patient ID: buscar, borrar o mover un paciente sin recorrer el árbol
+    rstarTree.enable_key_index([](const Paciente &paciente) { return paciente.id; });
+    // Las búsquedas por área eligen entre el árbol y un recorrido secuencial
+    rstarTree.enable_planner();
 
-    //rstarTree.print_tree((rstarTree.get_root()),0);
+    if (argc > 1 && string(argv[1]) == "--serve")
+    {
+        QueryServer<decltype(rstarTree), decltype(normalizador), Paciente> servidor(
+            rstarTree, normalizador, caracteristicasIndice,
+            [&siguienteId](const Caracteristicas &valores) {
+                Paciente paciente = pacienteDe(valores);
+                paciente.id = siguienteId++;
+                return paciente;
+            });
+        if (argc > 2)
+        {
+#ifndef _WIN32
+            serve_unix_socket(servidor, argv[2]);
+#else
+            cerr << "Unix sockets are not available on this platform" << endl;
+            return 1;
+#endif
+        }
+        else
+        {
+            ios::sync_with_stdio(false);
+            serve_stream(servidor, cin, cout);
+        }
+        return 0;
+    }
+
+    if (argc > 2 && (string(argv[1]) == "--export" || string(argv[1]) == "--dump"))
+    {
+        BufferedWriter salida(argv[2]);
+        export_format formato = export_format_of(argv[2]);
+        if (string(argv[1]) == "--dump")
+        {
+            export_tree(rstarTree, salida, formato);
+            return 0;
+        }
+        array<string, columnasPaciente> nombres;
+        copy(begin(columnasCovid), end(columnasCovid), nombres.begin());
+        RecordExporter<columnasPaciente> exportador(salida, formato, nombres);
+        // Se recorre todo el espacio; cada paciente se escribe apenas se encuentra
+        Caracteristicas lo, hi;
+        lo.fill(-numeric_limits<double>::infinity());
+        hi.fill(numeric_limits<double>::infinity());
+        export_area(rstarTree, normalizador.query_box(lo, hi), exportador, caracteristicasIndice);
+        return 0;
+    }
 
-    //Eliminacion de datos
+    //rstarTree.print_tree((rstarTree.get_root()),0);
 
-    auto box2 = createBox3D(1,15,0,1,1,1);
+    //Eliminacion de datos: examen positivo, edad 15, hematocrito entre 0 y 1
+    auto rango2 = rangoConsulta({1, 15, 0}, {1, 15, 1});
+    auto box2 = normalizador.query_box(rango2.first, rango2.second);
     rstarTree.delete_objects_in_area(box2);
     //rstarTree.print_tree((rstarTree.get_root()),0);
 
-    // auto box3 = createBox3D(1,15,0,1,3,2);
-    // rstarTree.delete_objects_in_area(box3);
     rstarTree.print_tree((rstarTree.get_root()),0);
 
-
-    auto areafind = createBox3D(1,15,0,1,3,2);
+    //Busqueda: examen positivo, edad de 15 a 17, hematocrito entre 0 y 2
+    auto rangofind = rangoConsulta({1, 15, 0}, {1, 17, 2});
+    auto areafind = normalizador.query_box(rangofind.first, rangofind.second);
     auto structure_res = rstarTree.find_objects_in_area(areafind);
     for (int i = 0; i < structure_res.size(); i++)
     {
-        cout<<"$$$$$$$$"<<endl;
-        cout<<structure_res[i].get_value()<<endl;
+        cout<<"$$$$$$$$\n";
+        cout<<structure_res[i].get_value()<<'\n';
     }
 
     return 0;
@@ -0,0 +1,155 @@
+#pragma once
+#include "boundingbox.h"
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+using namespace std;
+
+/*
+normalization indica cómo se lleva cada columna al espacio de índice:
+
+- zscore: (v - media) / desviación estándar.
+- minmax: (v - mínimo) / (máximo - mínimo), queda en [0, 1].
+*/
+enum class normalization
+{
+    zscore,
+    minmax
+};
+
+/*
+ColumnStats acumula las estadísticas de una columna en una sola
+pasada (algoritmo de Welford): cantidad, media, suma de cuadrados
+de las desviaciones (m2), mínimo y máximo. No guarda los valores.
+*/
+struct ColumnStats
+{
+    size_t count{0};
+    double mean{0};
+    double m2{0};
+    double min_value{numeric_limits<double>::max()};
+    double max_value{numeric_limits<double>::lowest()};
+
+    void add(double value)
+    {
+        count++;
+        double delta = value - mean;
+        mean += delta / count;
+        m2 += delta * (value - mean);
+        min_value = min(min_value, value);
+        max_value = max(max_value, value);
+    }
+
+    double stddev() const
+    {
+        return count > 1 ? sqrt(m2 / (count - 1)) : 0;
+    }
+};
+
+/*
+FeatureNormalizer es la etapa de ingesta que transforma las
+características elegidas de cada registro al espacio donde se indexan.
+
+* observe() se llama una vez por registro durante la lectura del
+archivo y actualiza las estadísticas de cada columna.
+* map() aplica la normalización elegida a un valor de una columna y,
+si se configuró set_quantization(bits), lo convierte además a punto
+fijo: floor(valor * 2^bits).
+* point_box() produce la caja (degenerada) de un registro y point()
+el mismo registro como RStarPoint, para árboles con hojas puntuales.
+* query_box() traduce un rango de consulta expresado en unidades
+originales al mismo espacio, de modo que la selectividad y la poda
+del árbol se calculan sobre los valores normalizados.
+
+Todas las transformaciones son monótonas no decrecientes, así que un
+valor dentro de [lo, hi] siempre cae dentro de [map(lo), map(hi)]. Sin
+cuantizar el resultado es exacto; con cuantización la consulta es
+conservadora y puede devolver registros de las celdas del borde.
+*/
+template <size_t dimensions, typename cost_type = double>
+class FeatureNormalizer
+{
+public:
+    using BoundingBox = RStarBoundingBox<dimensions, cost_type>;
+    using Point = RStarPoint<dimensions, cost_type>;
+    using Features = array<double, dimensions>;
+
+    explicit FeatureNormalizer(normalization mode_ = normalization::zscore)
+        : mode(mode_)
+    {
+    }
+
+    void observe(const Features &values)
+    {
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            columns[axis].add(values[axis]);
+        }
+    }
+
+    void set_quantization(unsigned bits)
+    {
+        scale = bits ? ldexp(1.0, bits) : 0;
+    }
+
+    const ColumnStats &stats(size_t axis) const { return columns[axis]; }
+
+    double map(size_t axis, double value) const
+    {
+        const ColumnStats &column = columns[axis];
+        double normalized = 0;
+        if (mode == normalization::zscore)
+        {
+            double deviation = column.stddev();
+            normalized = deviation > 0 ? (value - column.mean) / deviation : 0;
+        }
+        else
+        {
+            double range = column.max_value - column.min_value;
+            normalized = range > 0 ? (value - column.min_value) / range : 0;
+        }
+        if (scale > 0)
+        {
+            normalized = floor(normalized * scale);
+        }
+        return normalized;
+    }
+
+    BoundingBox point_box(const Features &values) const
+    {
+        BoundingBox box;
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            box.min_edges[axis] = box.max_edges[axis] = map(axis, values[axis]);
+        }
+        return box;
+    }
+
+    Point point(const Features &values) const
+    {
+        Point result;
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            result.coords[axis] = map(axis, values[axis]);
+        }
+        return result;
+    }
+
+    BoundingBox query_box(const Features &lo, const Features &hi) const
+    {
+        BoundingBox box;
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            box.min_edges[axis] = map(axis, lo[axis]);
+            box.max_edges[axis] = map(axis, hi[axis]);
+        }
+        return box;
+    }
+
+private:
+    normalization mode;
+    double scale{0}; //<2^bits when quantized, 0 otherwise
+    array<ColumnStats, dimensions> columns;
+};
@@ -0,0 +1,107 @@
+#pragma once
+#include <charconv>
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+/*
+Paciente guarda las 11 características numéricas de un registro de
+Files/covid_DB_datos_importantes_completos_double.csv, en el mismo
+orden que las columnas del archivo:
+
+a: SARS-Cov-2 exam result, b: Patient age quantile, c: Hematocrit,
+d: Platelets, e: Mean platelet volume, f: MCHC, g: Leukocytes,
+h: Basophils, i: Eosinophils, j: Monocytes, k: Proteina C reativa.
+
+id es el Patient ID del archivo crudo (ver idPaciente()); es la clave
+del índice por clave del árbol y no se indexa espacialmente.
+*/
+struct Paciente
+{
+    double a, b, c, d, e, f, g, h, i, j, k;
+    uint64_t id{0};
+};
+
+const size_t columnasPaciente = 11;
+
+// Campo del paciente por índice de columna (0 = a, ..., 10 = k).
+inline double Paciente::*const camposPaciente[columnasPaciente] = {
+    &Paciente::a, &Paciente::b, &Paciente::c, &Paciente::d,
+    &Paciente::e, &Paciente::f, &Paciente::g, &Paciente::h,
+    &Paciente::i, &Paciente::j, &Paciente::k};
+
+// Nombre de cada campo (0 = a, ..., 10 = k) en el encabezado del archivo
+// crudo Files/covid_DB.csv (Files/dataColumn.csv), con el espacio no
+// separable que trae el de MCHC. Se leen con CsvProjection.
+inline const char *const columnasCovid[columnasPaciente] = {
+    "SARS-Cov-2 exam result", "Patient age quantile", "Hematocrit", "Platelets",
+    "Mean platelet volume ", "Mean corpuscular hemoglobin concentration\u00a0(MCHC)",
+    "Leukocytes", "Basophils", "Eosinophils", "Monocytes", "Proteina C reativa mg/dL"};
+
+/*
+idPaciente() convierte el Patient ID de Files/covid_DB.csv en un
+entero. Los ids son 15 dígitos hexadecimales (60 bits), salvo unos
+pocos que una planilla dejó en notación científica ("3,33182E+14");
+esos se resumen con FNV-1a de 64 bits y se marcan con el bit 63 para
+que no choquen con los hexadecimales.
+*/
+inline uint64_t idPaciente(string_view texto)
+{
+    uint64_t id = 0;
+    auto result = from_chars(texto.data(), texto.data() + texto.size(), id, 16);
+    if (!texto.empty() && result.ec == errc() && result.ptr == texto.data() + texto.size() &&
+        id < (uint64_t(1) << 63))
+    {
+        return id;
+    }
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : texto)
+    {
+        hash = (hash ^ uint8_t(c)) * 1099511628211ull;
+    }
+    return hash | (uint64_t(1) << 63);
+}
+
+inline std::ostream& operator<<(std::ostream& out, const Paciente& point) 
+{
+    out << "(" << point.a << ", " << point.b << ", " << point.c
+    << "(" << point.d << ", " << point.e << ", " << point.f 
+    << "(" << point.g << ", " << point.h << ", " << point.i 
+    << "(" << point.j << ", " << point.k << ")";
+    return out;
+}
+
+// Función para parsear una línea del archivo CSV b obtener un punto 3D
+inline Paciente leerCSVLine(const string& line) 
+{
+    Paciente caractPaciente;
+    stringstream ss(line);
+    string token;
+    getline(ss, token, ',');
+    caractPaciente.a = stod(token);
+    getline(ss, token, ',');
+    caractPaciente.b = stod(token);
+    getline(ss, token, ',');
+    caractPaciente.c = stod(token);
+    getline(ss, token, ',');
+    caractPaciente.d = stod(token);
+    getline(ss, token, ',');
+    caractPaciente.e = stod(token);
+    getline(ss, token, ',');
+    caractPaciente.f = stod(token);
+    getline(ss, token, ',');
+    caractPaciente.g = stod(token);
+    getline(ss, token, ',');
+    caractPaciente.h = stod(token);
+    getline(ss, token, ',');
+    caractPaciente.i = stod(token);
+    getline(ss, token, ',');
+    caractPaciente.j = stod(token);
+    getline(ss, token, ',');
+    caractPaciente.k = stod(token);
+    return caractPaciente;
+}
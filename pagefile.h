@@ -0,0 +1,258 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Forces the written bytes of `file` to the disk.
+inline void sync_to_disk(FILE *file)
+{
+    fflush(file);
+#ifdef _WIN32
+    _commit(_fileno(file));
+#else
+    fsync(fileno(file));
+#endif
+}
+
+// FNV-1a de 32 bits; detecta registros cortados o corruptos.
+inline uint32_t fnv1a(const char *data, size_t size, uint32_t hash = 2166136261u)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ uint8_t(data[i])) * 16777619u;
+    }
+    return hash;
+}
+
+/*
+PageTable describe un estado del árbol guardado en un PageFile: la
+página raíz, la cantidad de valores, el próximo número de página
+libre, una etiqueta libre para quien llama (WriteAheadLog guarda ahí
+su generación) y, para cada página viva, dónde está su última versión
+en el archivo y cuántos bytes ocupa.
+*/
+struct PageTable
+{
+    struct Entry
+    {
+        uint64_t offset;
+        uint32_t bytes;
+    };
+
+    uint64_t layout{0};
+    uint32_t root{0};
+    uint64_t values{0};
+    uint32_t next_page{1};
+    uint64_t tag{0};
+    unordered_map<uint32_t, Entry> pages;
+};
+
+/*
+PageFile es el archivo de páginas de los checkpoints incrementales
+(RStarTree::checkpoint_pages()). Funciona por sombra (shadow paging):
+nunca se sobrescribe una página viva.
+
+* append_page() agrega al final del archivo la versión nueva de una
+página: número, largo, contenido y suma de verificación.
+* commit() agrega después una tabla con las páginas escritas en este
+checkpoint y el desplazamiento de la tabla anterior (la tabla de
+páginas es copy-on-write: cada checkpoint guarda solo sus cambios),
+fuerza todo al disco y recién entonces cambia el puntero a la última
+tabla, que está en el encabezado. Ese cambio de 8 bytes es el punto
+de confirmación: si hay una caída antes, el archivo sigue describiendo
+el checkpoint anterior.
+* read_table() recorre la cadena de tablas desde la última y se queda
+con la versión más nueva de cada página; read_page() lee una página y
+verifica su suma.
+
+Las versiones viejas quedan como basura hasta que el árbol reescribe
+el archivo completo (ver checkpoint_pages()).
+*/
+class PageFile
+{
+public:
+    PageFile(const string &path, bool create) : path(path)
+    {
+        file = fopen(path.c_str(), create ? "w+b" : "r+b");
+        if (!file)
+        {
+            throw invalid_argument("PageFile: cannot open " + path);
+        }
+        if (create)
+        {
+            uint64_t header[2] = {file_magic, 0};
+            write_at(0, header, sizeof(header));
+        }
+        fseek(file, 0, SEEK_END);
+        end = uint64_t(ftell(file));
+        if (!create)
+        {
+            uint64_t header[2];
+            if (!read_at(0, header, sizeof(header)) || header[0] != file_magic)
+            {
+                fclose(file);
+                throw invalid_argument("PageFile: not a page file " + path);
+            }
+            last_table = header[1];
+        }
+    }
+
+    ~PageFile()
+    {
+        fclose(file);
+    }
+
+    PageFile(const PageFile &) = delete;
+    PageFile &operator=(const PageFile &) = delete;
+
+    uint64_t size() const { return end; }
+    bool empty() const { return last_table == 0; }
+
+    void append_page(uint32_t page, const string &payload)
+    {
+        uint32_t bytes = uint32_t(payload.size());
+        uint32_t sum = fnv1a(payload.data(), payload.size(), page);
+        written.push_back({page, {end, bytes}});
+        write_at(end, &page, sizeof(page));
+        write_at(end + 4, &bytes, sizeof(bytes));
+        write_at(end + 8, payload.data(), bytes);
+        write_at(end + 8 + bytes, &sum, sizeof(sum));
+        end += 12 + bytes;
+    }
+
+    void commit(const PageTable &state)
+    {
+        vector<char> table;
+        auto put = [&table](const void *data, size_t size)
+        {
+            const char *bytes = static_cast<const char *>(data);
+            table.insert(table.end(), bytes, bytes + size);
+        };
+        uint64_t count = written.size();
+        put(&table_magic, sizeof(table_magic));
+        put(&last_table, sizeof(last_table));
+        put(&state.layout, sizeof(state.layout));
+        put(&state.root, sizeof(state.root));
+        put(&state.values, sizeof(state.values));
+        put(&state.next_page, sizeof(state.next_page));
+        put(&state.tag, sizeof(state.tag));
+        put(&count, sizeof(count));
+        for (auto &page : written)
+        {
+            put(&page.first, sizeof(page.first));
+            put(&page.second.offset, sizeof(page.second.offset));
+            put(&page.second.bytes, sizeof(page.second.bytes));
+        }
+        uint32_t sum = fnv1a(table.data(), table.size());
+        put(&sum, sizeof(sum));
+        uint64_t table_offset = end;
+        write_at(end, table.data(), table.size());
+        end += table.size();
+        sync_to_disk(file);
+        write_at(8, &table_offset, sizeof(table_offset));
+        sync_to_disk(file);
+        last_table = table_offset;
+        written.clear();
+    }
+
+    PageTable read_table()
+    {
+        PageTable state;
+        bool newest = true;
+        for (uint64_t offset = last_table; offset != 0;)
+        {
+            uint64_t head[2], layout, values, tag, count;
+            uint32_t root, next_page;
+            bool ok = read_at(offset, head, sizeof(head)) && head[0] == table_magic &&
+                      read_at(offset + 16, &layout, 8) && read_at(offset + 24, &root, 4) &&
+                      read_at(offset + 28, &values, 8) && read_at(offset + 36, &next_page, 4) &&
+                      read_at(offset + 40, &tag, 8) && read_at(offset + 48, &count, 8) &&
+                      count <= (end - offset) / 16;
+            vector<char> entries(ok ? count * 16 + 4 : 0);
+            ok = ok && read_at(offset + 56, entries.data(), entries.size());
+            if (ok)
+            {
+                vector<char> table(56 + count * 16);
+                read_at(offset, table.data(), table.size());
+                uint32_t sum;
+                memcpy(&sum, entries.data() + count * 16, sizeof(sum));
+                ok = sum == fnv1a(table.data(), table.size());
+            }
+            if (!ok)
+            {
+                throw invalid_argument("PageFile: corrupt page table in " + path);
+            }
+            if (newest)
+            {
+                state.layout = layout;
+                state.root = root;
+                state.values = values;
+                state.next_page = next_page;
+                state.tag = tag;
+                newest = false;
+            }
+            for (uint64_t i = 0; i < count; i++)
+            {
+                uint32_t page, bytes;
+                uint64_t page_offset;
+                memcpy(&page, entries.data() + 16 * i, 4);
+                memcpy(&page_offset, entries.data() + 16 * i + 4, 8);
+                memcpy(&bytes, entries.data() + 16 * i + 12, 4);
+                state.pages.insert({page, {page_offset, bytes}}); // keeps the newest version
+            }
+            offset = head[1];
+        }
+        return state;
+    }
+
+    string read_page(uint32_t page, const PageTable::Entry &entry)
+    {
+        uint32_t stored_page, bytes, sum;
+        string payload(entry.bytes, '\0');
+        if (!read_at(entry.offset, &stored_page, 4) || !read_at(entry.offset + 4, &bytes, 4) ||
+            stored_page != page || bytes != entry.bytes ||
+            !read_at(entry.offset + 8, &payload[0], bytes) ||
+            !read_at(entry.offset + 8 + bytes, &sum, 4) ||
+            sum != fnv1a(payload.data(), payload.size(), page))
+        {
+            throw invalid_argument("PageFile: corrupt page in " + path);
+        }
+        return payload;
+    }
+
+private:
+    static constexpr uint64_t file_magic = 0x3145474150525452;  // "RTRPAGE1"
+    static constexpr uint64_t table_magic = 0x3142415447415052; // "RPAGTAB1"
+
+    void write_at(uint64_t offset, const void *data, size_t size)
+    {
+        if (fseek(file, long(offset), SEEK_SET) != 0 || fwrite(data, 1, size, file) != size)
+        {
+            throw invalid_argument("PageFile: cannot write " + path);
+        }
+    }
+
+    bool read_at(uint64_t offset, void *data, size_t size)
+    {
+        return offset + size <= end && fseek(file, long(offset), SEEK_SET) == 0 &&
+               fread(data, 1, size, file) == size;
+    }
+
+    string path;
+    FILE *file{nullptr};
+    uint64_t end{0};
+    uint64_t last_table{0};
+    vector<pair<uint32_t, PageTable::Entry>> written;
+};
@@ -0,0 +1,215 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*
+Utilidades de paralelismo usadas por la construcción masiva del árbol
+(RStarTree::bulk_load) y por las búsquedas paralelas. Se compilan con
+-pthread.
+
+* parallel_for() ejecuta f(i) para cada i en [0, tasks) con hasta
+`threads` hilos. Los hilos toman la siguiente tarea libre de un
+contador atómico, así las tareas de distinto costo se reparten solas.
+El hilo que llama también trabaja; con threads <= 1 todo corre en él
+sin crear hilos.
+* parallel_sort() ordena `threads` tramos en paralelo y luego los
+mezcla de a pares con inplace_merge, también en paralelo.
+*/
+template <typename F>
+void parallel_for(size_t tasks, unsigned threads, F f)
+{
+    size_t workers = min<size_t>(max(threads, 1u), tasks);
+    atomic<size_t> next{0};
+    auto worker = [&]()
+    {
+        for (size_t i = next++; i < tasks; i = next++)
+        {
+            f(i);
+        }
+    };
+    vector<thread> pool;
+    for (size_t t = 1; t < workers; t++)
+    {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (thread &t : pool)
+    {
+        t.join();
+    }
+}
+
+template <typename Iter, typename Compare>
+void parallel_sort(Iter first, Iter last, Compare compare, unsigned threads)
+{
+    size_t n = last - first;
+    size_t parts = min<size_t>(max(threads, 1u), n / 4096 + 1);
+    if (parts <= 1)
+    {
+        sort(first, last, compare);
+        return;
+    }
+    auto bound = [&](size_t part) { return first + n * part / parts; };
+    parallel_for(parts, threads, [&](size_t part)
+                 { sort(bound(part), bound(part + 1), compare); });
+    for (size_t width = 1; width < parts; width *= 2)
+    {
+        parallel_for((parts + 2 * width - 1) / (2 * width), threads, [&](size_t k)
+                     {
+                         size_t lo = 2 * width * k;
+                         size_t mid = min(parts, lo + width);
+                         size_t hi = min(parts, lo + 2 * width);
+                         inplace_merge(bound(lo), bound(mid), bound(hi), compare); });
+    }
+}
+
+/*
+WorkStealingPool es un grupo de hilos persistentes para repartir el
+recorrido de una búsqueda grande. Cada hilo (worker) tiene su propia
+cola de tareas: agrega y toma tareas por el final de la suya y, cuando
+se queda sin trabajo, roba la tarea más antigua de la cola de otro.
+Una tarea recibe el número del worker que la ejecuta, así puede
+escribir en un búfer propio sin sincronización.
+
+* run(root) ejecuta `root` en el hilo que llama (worker 0) y espera a
+que terminen todas las tareas que se crearon con spawn() durante la
+ejecución. Los hilos del grupo solo trabajan mientras hay un run()
+en curso; el resto del tiempo duermen.
+* spawn(worker, task) agrega una tarea a la cola de `worker`.
+
+Se ejecuta un run() a la vez; las llamadas concurrentes esperan.
+*/
+class WorkStealingPool
+{
+public:
+    using Task = function<void(unsigned)>;
+
+    explicit WorkStealingPool(unsigned threads) : queues(max(threads, 1u))
+    {
+        for (unsigned worker = 1; worker < queues.size(); worker++)
+        {
+            threads_.emplace_back([this, worker]()
+                                  { worker_loop(worker); });
+        }
+    }
+
+    ~WorkStealingPool()
+    {
+        {
+            lock_guard<mutex> lock(state_mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (thread &t : threads_)
+        {
+            t.join();
+        }
+    }
+
+    unsigned size() const { return unsigned(queues.size()); }
+
+    void run(Task root)
+    {
+        lock_guard<mutex> job(run_mutex);
+        pending = 1;
+        {
+            lock_guard<mutex> lock(state_mutex);
+            active = true;
+        }
+        wake.notify_all();
+        execute(root, 0);
+        while (pending > 0)
+        {
+            if (!run_one(0))
+                this_thread::yield();
+        }
+        lock_guard<mutex> lock(state_mutex);
+        active = false;
+    }
+
+    void spawn(unsigned worker, Task task)
+    {
+        pending++;
+        lock_guard<mutex> lock(queues[worker].lock);
+        queues[worker].tasks.push_back(move(task));
+    }
+
+private:
+    struct Queue
+    {
+        mutex lock;
+        deque<Task> tasks;
+    };
+
+    void execute(Task &task, unsigned worker)
+    {
+        task(worker);
+        pending--;
+    }
+
+    // Own queue first (newest task), then the oldest task of another worker.
+    bool run_one(unsigned worker)
+    {
+        Task task;
+        for (size_t k = 0; k < queues.size() && !task; k++)
+        {
+            Queue &queue = queues[(worker + k) % queues.size()];
+            lock_guard<mutex> lock(queue.lock);
+            if (!queue.tasks.empty())
+            {
+                if (k == 0)
+                {
+                    task = move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                }
+                else
+                {
+                    task = move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+            }
+        }
+        if (!task)
+        {
+            return false;
+        }
+        execute(task, worker);
+        return true;
+    }
+
+    void worker_loop(unsigned worker)
+    {
+        while (true)
+        {
+            {
+                unique_lock<mutex> lock(state_mutex);
+                wake.wait(lock, [this]()
+                          { return stopping || active; });
+                if (stopping)
+                    return;
+            }
+            while (active)
+            {
+                if (!run_one(worker))
+                    this_thread::yield();
+            }
+        }
+    }
+
+    vector<Queue> queues;
+    vector<thread> threads_;
+    mutex run_mutex, state_mutex;
+    condition_variable wake;
+    atomic<size_t> pending{0};
+    atomic<bool> active{false};
+    bool stopping{false};
+};
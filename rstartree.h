@@ -1,51 +1,133 @@
 #pragma once
 #include <iostream>
 #include "boundingbox.h"
+#include "childarray.h"
+#include "pagefile.h"
+#include "parallel.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <fstream>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <numeric>
 #include <queue>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 // using BoundingBox = RStarBoundingBox<2>;
 
 using namespace std;
 
+/*
+query_type indica el predicado que deben cumplir las hojas devueltas
+por una búsqueda:
+
+- intersects: la caja de la hoja se intersecta con el área de búsqueda.
+- within: la caja de la hoja está completamente dentro del área.
+- contains: la caja de la hoja contiene completamente al área.
+- overlaps: la caja de la hoja comparte con el área un volumen
+positivo (is_intersected()). Es el predicado original de
+find_objects_in_area() y delete_objects_in_area(): a diferencia de
+intersects, una caja degenerada nunca cumple. Con hojas puntuales es
+igual a intersects.
+*/
+enum class query_type
+{
+    intersects,
+    within,
+    contains,
+    overlaps
+};
+
 /*
 T, que representa el tipo de datos que se almacenará en el árbol.
 dimensions, que representa el número de dimensiones para la ubicación espacial de los datos.
 min_child_items y max_child_items, que son parámetros para determinar cuántos elementos mínimos y máximos pueden estar en cada nodo del árbol.
+cost_type, el tipo aritmético de las métricas de costo (área, margen, solapamiento) que guían choose_subtree y split; double por defecto, int64_t para datos enteros.
+point_leaves, si es true las hojas guardan un RStarPoint (una tupla de coordenadas) en lugar de una caja; es el modo para datos puntuales.
 */
 
 template <typename LeafType, size_t dimensions,
-          size_t min_child_items, size_t max_child_items>
+          size_t min_child_items, size_t max_child_items,
+          typename cost_type = double, bool point_leaves = false>
 
 class RStarTree
 {
-    using BoundingBox = RStarBoundingBox<dimensions>;
+    using BoundingBox = RStarBoundingBox<dimensions, cost_type>;
+
+public:
+    using Point = RStarPoint<dimensions, cost_type>;
+    // Geometría de una hoja: un punto en modo point_leaves, si no una caja.
+    using LeafGeometry = conditional_t<point_leaves, Point, BoundingBox>;
+    // Tipo de los valores y caja de las búsquedas y eliminaciones por área.
+    using Value = LeafType;
+    using Area = BoundingBox;
+    // Clave estable de un valor en el índice por clave (enable_key_index()).
+    using Handle = uint64_t;
+    // Peso de cada eje en las búsquedas por distancia.
+    using Weights = array<double, dimensions>;
 
 private:
     /*
-    TreePart: Representa una parte genérica del árbol,
-    tiene un atributo BoundingBox llamado box. Esta estructura es
-    una especie de "molde" común para nodos y hojas.
+    TreePart: Representa una parte genérica del árbol. Es una
+    especie de "molde" común para nodos y hojas que permite
+    guardarlos en el mismo vector de hijos. Los nodos guardan una caja
+    (BoundingBox) y las hojas su geometría (LeafGeometry), ambas en un
+    atributo llamado box.
+
+    parent es el nodo que tiene a esta parte entre sus hijos (nullptr
+    o un valor viejo en la raíz). No se mantiene en cada sitio que
+    mueve hijos: sync_child_boxes(), que se llama después de cada
+    cambio en los hijos de un nodo, lo reescribe en todos ellos. Con
+    él update(), erase_key() y update_key() llegan desde una hoja a la
+    raíz sin recorrer el árbol.
     */
+    struct Node;
+
     struct TreePart
     {
-        BoundingBox box;
+        Node *parent{nullptr};
     };
 
     /*
     Node: Es una estructura que hereda de TreePart y
     representa los nodos internos del árbol. Contiene
-    un vector de punteros a TreePart llamado items que
+    un arreglo de punteros a TreePart llamado items que
     almacenará las referencias a las partes del árbol
     (nodos u hojas) y un indicador hasleaves que informa
     si el nodo contiene hojas.
+
+    items y child_boxes son ChildArray de max_child_items + 1
+    elementos guardados dentro del nodo: child_boxes[i] es una copia
+    de la caja del hijo i (bordes mínimo y máximo intercalados por
+    eje). Las búsquedas descartan hijos leyendo solo esas copias, sin
+    visitar cada hijo, así bajar un nivel toca un solo bloque de
+    memoria. El nodo se alinea a la línea de caché (64 bytes). Las
+    cajas de los hijos siguen siendo las autoritativas; refresh_box()
+    y sync_child_boxes() actualizan las copias después de cada cambio.
+
+    page es el número de página del nodo en el archivo de
+    checkpoint_pages() (0 si todavía no se escribió) y dirty indica que
+    sus hijos cambiaron desde el último checkpoint (ver mark_dirty()).
     */
-    struct Node : public TreePart
+    using ChildBox = array<double, 2 * dimensions>;
+
+    struct alignas(64) Node : public TreePart
     {
-        vector<TreePart *> items;
-        int hasleaves{false};
+        BoundingBox box;
+        ChildArray<TreePart *, max_child_items + 1> items;
+        ChildArray<ChildBox, max_child_items + 1> child_boxes;
+        bool hasleaves{false};
+        bool dirty{false};
+        uint32_t page{0};
     };
 
     /*
@@ -53,10 +135,22 @@ private:
     representa las hojas del árbol. Contiene un atributo
     LeafType llamado value, que almacena el valor específico
      del tipo de hoja que se define en el árbol.
+
+    Cuando varios valores se insertan con exactamente la misma caja,
+    no se crean hojas nuevas: los valores adicionales se agrupan en
+    `bucket`. Así una hoja representa count() valores y el árbol no
+    forma cadenas de nodos que se solapan por completo. Un vector
+    vacío no reserva memoria, así que las hojas con un solo valor no
+    pagan nada extra.
     */
     struct Leaf : public TreePart
     {
+        LeafGeometry box;
         LeafType value;
+        vector<LeafType> bucket; //<values sharing this exact box
+
+        size_t count() const { return 1 + bucket.size(); }
+        LeafType &at(size_t slot) { return slot == 0 ? value : bucket[slot - 1]; }
     };
 
     /*
@@ -85,246 +179,2029 @@ public:
         hoja de una manera controlada.
 
         LeafWithConstBox tiene métodos públicos como get_box() y get_value()
-        para obtener la referencia constante a la caja delimitadora (BoundingBox)
-        y al valor almacenado en la hoja (LeafType), respectivamente.
+        para obtener la referencia constante a la geometría de la hoja
+        (LeafGeometry: caja, o punto en modo point_leaves) y al valor
+        almacenado en la hoja (LeafType), respectivamente.
+
+        `slot` indica cuál de los valores agrupados en la hoja se
+        representa (0 es `value`, los siguientes están en `bucket`).
         */
-        LeafWithConstBox(Leaf *leaf_) : leaf(leaf_) {}
+        LeafWithConstBox(Leaf *leaf_, size_t slot_ = 0) : leaf(leaf_), slot(slot_) {}
 
-        const BoundingBox &get_box() const { return leaf->box; }
-        const BoundingBox &get_box() { return leaf->box; }
-        const LeafType &get_value() const { return leaf->value; }
+        const LeafGeometry &get_box() const { return leaf->box; }
+        const LeafGeometry &get_box() { return leaf->box; }
+        const LeafType &get_value() const { return leaf->at(slot); }
 
-        LeafType &get_value() { return leaf->value; }
+        LeafType &get_value() { return leaf->at(slot); }
         bool operator<(const LeafWithConstBox &rhs) const
         {
-            if (get_value() == rhs.get_value())
+            if (get_value() == rhs.get_value())
+            {
+                return get_box() < rhs.get_box();
+            }
+            return get_value() < rhs.get_value();
+        }
+        bool operator==(const LeafWithConstBox &rhs) const
+        {
+            return get_value() == rhs.get_value() && get_box() == rhs.get_box();
+        }
+        bool operator!=(const LeafWithConstBox &rhs) const
+        {
+            return !operator==(rhs);
+        }
+
+    public:
+        Leaf *leaf{nullptr};
+        size_t slot{0};
+    };
+
+public:
+    RStarTree()
+    {
+        if (dimensions <= 0 || max_child_items < min_child_items)
+        {
+            throw invalid_argument("");
+        }
+    }
+    ~RStarTree()
+    {
+        if (tree_root)
+        {
+            delete_tree(tree_root);
+        }
+    }
+
+    /*
+    La función insert() permite insertar una hoja en el
+    árbol. Toma como argumentos un valor de hoja (LeafType)
+     y un área delimitadora (BoundingBox), o un punto si el árbol
+     usa hojas puntuales.
+     Dentro de esta función:
+
+    * Se incrementa el tamaño (size_) del árbol.
+    * Se crea una nueva hoja Leaf y se le asigna el valor
+        proporcionado (leaf) y la caja delimitadora (box).
+    * Si el árbol está vacío (!tree_root), se crea un nuevo
+     nodo raíz y se inserta la hoja en él.
+    * En caso contrario, se invoca a la función
+    choose_leaf_and_insert() para encontrar el nodo
+    hoja adecuado y realizar la inserción.
+    * used_deeps.clear() se usa para limpiar un contenedor
+    (posiblemente un conjunto o un vector) llamado used_deeps.
+    * Si bucket_duplicates está activo y ya existe una hoja con
+    exactamente la misma caja (find_equal_leaf()), el valor se agrega
+    a su bucket y el árbol no cambia de forma.
+
+    Con el índice por clave activo (enable_key_index()) devuelve la
+    clave del valor, su handle estable; si no, devuelve 0.
+    */
+    Handle insert(const LeafType leaf, const LeafGeometry &box)
+    {
+        Handle key = key_of ? key_of(leaf) : 0;
+        if (key_of && key_index.count(key))
+        {
+            throw invalid_argument("insert: duplicate key");
+        }
+        size_++;
+        version_++;
+        if (bucket_duplicates && tree_root)
+        {
+            Node *owner = nullptr;
+            if (Leaf *twin = find_equal_leaf(box, tree_root, owner))
+            {
+                twin->bucket.push_back(leaf);
+                mark_dirty(owner);
+                index_value(leaf, twin);
+                return key;
+            }
+        }
+        Leaf *new_leaf = new Leaf;
+        new_leaf->value = leaf;
+        new_leaf->box = box;
+        index_value(leaf, new_leaf);
+        if (!tree_root)
+        {
+            tree_root = new Node();
+            tree_root->hasleaves = true;
+            tree_root->items.push_back(new_leaf);
+            refresh_box(tree_root);
+        }
+        else
+        {
+            choose_leaf_and_insert(new_leaf, tree_root);
+        }
+        used_deeps.clear();
+        return key;
+    }
+
+    /*
+    bulk_load() construye el árbol de una sola vez a partir de un
+    arreglo de registros (valor, geometría), con el empaquetado STR
+    (Sort-Tile-Recursive) en lugar de insertar uno por uno:
+
+    1. Se ordenan los registros por el centro en el eje 0, se cortan en
+    franjas (slabs) y cada franja se ordena por el eje siguiente, y así
+    hasta el último eje. Las franjas son independientes y se ordenan en
+    paralelo (str_sort()).
+    2. El arreglo ordenado se corta en grupos consecutivos de tamaño
+    parecido y cada grupo se empaqueta como un subárbol independiente
+    en un hilo distinto (pack()). Todos los subárboles tienen la misma
+    altura, porque los grupos se eligen de max_child_items^h registros.
+    3. Las raíces de los subárboles se empaquetan con el mismo método
+    hasta que queda una sola, que es la raíz del árbol.
+
+    Cada nodo recibe entre max_child_items / 2 y max_child_items hijos.
+    El árbol debe estar vacío. Si bucket_duplicates está activo, los
+    valores con geometría repetida se agrupan en una hoja, como en
+    insert(), en el orden en que llegan. `threads` es la cantidad de
+    hilos; por defecto 1, que no crea ningún hilo. La versión paralela
+    se pide explícitamente cuando `benchmark bulk` muestra que gana en
+    la máquina donde se usa.
+    */
+    void bulk_load(vector<pair<LeafType, LeafGeometry>> records, unsigned threads = 1)
+    {
+        if (tree_root)
+        {
+            throw invalid_argument("bulk_load: the tree must be empty");
+        }
+        if (records.empty())
+        {
+            return;
+        }
+        threads = max(threads, 1u);
+        size_t values = records.size();
+        vector<TreePart *> leaves;
+        if (bucket_duplicates)
+        {
+            // Equal geometries end up adjacent; each run becomes one leaf
+            vector<size_t> order(values);
+            iota(order.begin(), order.end(), 0);
+            stable_sort(order.begin(), order.end(), [&records](size_t a, size_t b)
+                        { return records[a].second < records[b].second; });
+            for (size_t i = 0; i < values;)
+            {
+                Leaf *leaf = new Leaf;
+                leaf->value = move(records[order[i]].first);
+                leaf->box = records[order[i]].second;
+                for (i++; i < values && records[order[i]].second == leaf->box; i++)
+                {
+                    leaf->bucket.push_back(move(records[order[i]].first));
+                }
+                leaves.push_back(leaf);
+            }
+        }
+        else
+        {
+            leaves.resize(values);
+            size_t blocks = (values + 4095) / 4096;
+            parallel_for(blocks, threads, [&](size_t block)
+                         {
+                             for (size_t i = block * 4096; i < min(values, (block + 1) * 4096); i++)
+                             {
+                                 Leaf *leaf = new Leaf;
+                                 leaf->value = move(records[i].first);
+                                 leaf->box = move(records[i].second);
+                                 leaves[i] = leaf;
+                             } });
+        }
+        size_t n = leaves.size();
+
+        // Records per subtree: the largest max_child_items^h that still
+        // leaves about four subtrees per thread.
+        size_t group = max_child_items;
+        while (group * max_child_items <= n / (4 * threads))
+        {
+            group *= max_child_items;
+        }
+        str_sort(leaves.begin(), leaves.end(), 0, group, true, threads);
+        size_t groups = (n + group - 1) / group;
+        vector<TreePart *> roots(groups);
+        parallel_for(groups, threads, [&](size_t g)
+                     {
+                         vector<TreePart *> level(leaves.begin() + n * g / groups,
+                                                  leaves.begin() + n * (g + 1) / groups);
+                         bool hasleaves = true;
+                         do
+                         {
+                             level = pack(level, hasleaves);
+                             hasleaves = false;
+                         } while (level.size() > 1);
+                         roots[g] = level.front(); });
+        while (roots.size() > 1)
+        {
+            roots = pack(roots, false);
+        }
+        tree_root = static_cast<Node *>(roots.front());
+        size_ += values;
+        version_++;
+        rebuild_key_index();
+    }
+
+    /*
+    find_objects_in_area() es un método que busca objetos
+    dentro de un área específica. Toma como argumento un cuadro
+    delimitador (BoundingBox). Dentro de esta función:
+
+    * Se crea un vector de LeafWithConstBox llamado leafs.
+    * Se llama a la función find_leaf() para buscar las hojas
+    que se encuentran dentro del área especificada. Estas hojas
+    se almacenan en el vector leafs.
+    * Retorna el vector leafs, que contiene las hojas encontradas
+    dentro del área.
+
+    Una hoja se encuentra si su caja se intersecta con el área según
+    is_intersected() (query_type::overlaps).
+    */
+    vector<LeafWithConstBox> find_objects_in_area(const BoundingBox &box)
+    {
+        vector<LeafWithConstBox> leafs;
+        search(box, leafs, query_type::overlaps);
+        return leafs;
+    }
+
+    /*
+    Búsquedas con predicado explícito. Las tres usan find_leaf() con
+    el query_type correspondiente:
+
+    * find_objects_intersecting(): hojas cuya caja toca `box`. A
+    diferencia de find_objects_in_area() también cuenta las cajas
+    degeneradas, como un punto guardado en una caja de lado cero.
+    * find_objects_within(): hojas cuya caja queda dentro de `box`.
+    * find_objects_containing(): hojas cuya caja contiene a `box`.
+    */
+    vector<LeafWithConstBox> find_objects_intersecting(const BoundingBox &box)
+    {
+        return find_objects(box, query_type::intersects);
+    }
+
+    vector<LeafWithConstBox> find_objects_within(const BoundingBox &box)
+    {
+        return find_objects(box, query_type::within);
+    }
+
+    vector<LeafWithConstBox> find_objects_containing(const BoundingBox &box)
+    {
+        return find_objects(box, query_type::contains);
+    }
+
+    vector<LeafWithConstBox> find_objects(const BoundingBox &box, query_type type)
+    {
+        vector<LeafWithConstBox> leafs;
+        search(box, leafs, type);
+        return leafs;
+    }
+
+    /*
+    Planificador de búsquedas por área. Para una ventana muy ancha,
+    bajar por el árbol prueba casi todas las cajas de casi todos los
+    nodos, saltando de nodo en nodo; recorrer en orden un arreglo
+    compacto con la geometría de todas las hojas hace menos trabajo por
+    hoja. Con enable_planner() cada búsqueda de find_objects(),
+    find_objects_in_area(), ... elige entre las dos según plan_query()
+    y reserva el vector de resultados con la estimación.
+
+    * analyze() junta las estadísticas: por nivel, la cantidad de nodos,
+    de hijos y el lado medio de las cajas de los nodos; y un histograma
+    de rejilla sobre la caja de la raíz, con a lo sumo histogram_cells
+    celdas y una cada 8 valores (la misma cantidad de divisiones por
+    eje), que cuenta los valores por el centro de su geometría; además,
+    por eje, un histograma de 64 intervalos de esos mismos centros.
+    Para los ejes con pocos valores distintos (256 o menos, como una
+    edad por cuantiles) guarda la separación entre valores. No hace
+    falta llamarlo: plan_query() lo repite cuando el árbol cambió más
+    de una cuarta parte desde el último análisis.
+    * estimate_results() estima la cantidad de valores que intersectan
+    `box`. Dentro de cada celda de la rejilla reparte los valores de
+    cada eje según el histograma de ese eje, con los ejes
+    independientes; con pocos datos la rejilla tiene una sola celda y
+    la estimación queda en los histogramas por eje. En un eje discreto
+    la ventana se ensancha media separación de cada lado, así [15, 17]
+    cuenta tres edades y no dos.
+    * plan_query() estima el costo del árbol como la cantidad de cajas
+    hijas probadas: en cada nivel, nodos × probabilidad de que la
+    ventana toque uno (producto por eje de (lado medio + ancho de la
+    ventana) / ancho de la raíz, acotado a 1) × hijos por nodo. El
+    costo del recorrido secuencial es hojas × dimensiones ×
+    scan_axis_cost, más una unidad por hoja si hay que reconstruir el
+    arreglo. Las búsquedas contains siempre van por el árbol.
+    * find_objects_scan() es el recorrido secuencial: prueba las hojas
+    de a bloques de 256, un eje por vez, sin saltos condicionales,
+    sobre un arreglo ordenado por eje (todas las coordenadas del eje 0,
+    después las del eje 1, ...) que el compilador puede vectorizar.
+    Las hojas con caja que tocan la ventana se confirman con la prueba
+    exacta de intersects u overlaps. El arreglo copia la geometría de las hojas y
+    se reconstruye en la primera búsqueda después de una modificación.
+
+    El resultado es el mismo que el de find_leaf(), pero en otro orden.
+    */
+    struct QueryPlan
+    {
+        bool scan{false};
+        double estimated_results{0};
+        double tree_cost{0};
+        double scan_cost{0};
+    };
+
+    void enable_planner(size_t cells = 4096)
+    {
+        planner = true;
+        histogram_cells = max<size_t>(cells, 1);
+        analyze();
+    }
+
+    void disable_planner()
+    {
+        planner = false;
+        selectivity = SelectivityStats();
+        vector<double>().swap(scan_lo);
+        vector<double>().swap(scan_hi);
+        vector<Leaf *>().swap(scan_leaves);
+        scan_version_ = numeric_limits<size_t>::max();
+    }
+
+    void analyze()
+    {
+        SelectivityStats stats;
+        stats.version = version_;
+        stats.values = size_;
+        if (!tree_root)
+        {
+            selectivity = move(stats);
+            return;
+        }
+        stats.bounds = tree_root->box;
+        const size_t cells = min(histogram_cells, max<size_t>(size_ / 8, 1));
+        while (stats.side < cells && pow(double(stats.side + 1), double(dimensions)) <= double(cells))
+        {
+            stats.side++;
+        }
+        stats.cells.assign(size_t(pow(double(stats.side), double(dimensions)) + 0.5), 0);
+        array<unordered_set<double>, dimensions> distinct;
+        analyze_node(tree_root, 0, stats, distinct);
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            partial_sum(stats.marginal[axis].begin(), stats.marginal[axis].end(), stats.marginal[axis].begin());
+            double extent = stats.bounds.max_edges[axis] - stats.bounds.min_edges[axis];
+            if (distinct[axis].size() > 1 && distinct[axis].size() <= 256)
+            {
+                stats.spacing[axis] = extent / double(distinct[axis].size() - 1);
+            }
+        }
+        selectivity = move(stats);
+    }
+
+    double estimate_results(const BoundingBox &box)
+    {
+        refresh_selectivity();
+        const SelectivityStats &stats = selectivity;
+        if (stats.cells.empty())
+        {
+            return 0;
+        }
+        const size_t side = stats.side;
+        array<size_t, dimensions> first, last;
+        vector<double> fractions(dimensions * side, 0.0);
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            double low = stats.bounds.min_edges[axis], high = stats.bounds.max_edges[axis];
+            double lo = max(box.min_edges[axis] - stats.spacing[axis] / 2, low);
+            double hi = min(box.max_edges[axis] + stats.spacing[axis] / 2, high);
+            if (lo > hi)
+            {
+                return 0;
+            }
+            double width = (high - low) / double(side);
+            if (width <= 0)
+            {
+                first[axis] = last[axis] = 0;
+                fractions[axis * side] = 1;
+                continue;
+            }
+            first[axis] = min(size_t((lo - low) / width), side - 1);
+            last[axis] = min(size_t((hi - low) / width), side - 1);
+            for (size_t cell = first[axis]; cell <= last[axis]; cell++)
+            {
+                double cell_lo = low + double(cell) * width;
+                double cell_hi = cell == side - 1 ? high : cell_lo + width;
+                double mass = axis_mass(stats, axis, cell_lo, cell_hi);
+                fractions[axis * side + cell] =
+                    mass > 0 ? axis_mass(stats, axis, max(lo, cell_lo), min(hi, cell_hi)) / mass
+                             : (min(hi, cell_hi) - max(lo, cell_lo)) / width;
+            }
+        }
+        double total = 0;
+        array<size_t, dimensions> cell = first;
+        while (true)
+        { // every cell of the window, as an odometer over the axes
+            size_t index = 0;
+            double fraction = 1;
+            for (size_t axis = dimensions; axis-- > 0;)
+            {
+                index = index * side + cell[axis];
+                fraction *= fractions[axis * side + cell[axis]];
+            }
+            total += fraction * stats.cells[index];
+            size_t axis = 0;
+            while (axis < dimensions && cell[axis] == last[axis])
+            {
+                cell[axis] = first[axis];
+                axis++;
+            }
+            if (axis == dimensions)
+            {
+                break;
+            }
+            cell[axis]++;
+        }
+        return total;
+    }
+
+    QueryPlan plan_query(const BoundingBox &box, query_type type = query_type::intersects)
+    {
+        QueryPlan plan;
+        if (!tree_root)
+        {
+            return plan;
+        }
+        plan.estimated_results = estimate_results(box);
+        const SelectivityStats &stats = selectivity;
+        array<double, dimensions> window, extent;
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            extent[axis] = stats.bounds.max_edges[axis] - stats.bounds.min_edges[axis];
+            window[axis] = min(box.max_edges[axis], stats.bounds.max_edges[axis]) -
+                           max(box.min_edges[axis], stats.bounds.min_edges[axis]);
+            if (window[axis] < 0)
+            { // the window misses the tree: the root rejects it
+                plan.tree_cost = double(tree_root->items.size());
+                return plan;
+            }
+        }
+        for (const LevelStats &level : stats.levels)
+        {
+            double touched = double(level.nodes);
+            for (size_t axis = 0; axis < dimensions; axis++)
+            {
+                if (extent[axis] > 0)
+                    touched *= min(1.0, (level.side[axis] / double(level.nodes) + window[axis]) / extent[axis]);
+            }
+            plan.tree_cost += touched * double(level.children) / double(level.nodes);
+        }
+        plan.scan_cost = double(stats.leaves) * dimensions * scan_axis_cost;
+        if (scan_version_ != version_)
+        {
+            plan.scan_cost += double(stats.leaves);
+        }
+        plan.scan = type != query_type::contains && plan.scan_cost < plan.tree_cost;
+        return plan;
+    }
+
+    vector<LeafWithConstBox> find_objects_scan(const BoundingBox &box,
+                                               query_type type = query_type::intersects)
+    {
+        vector<LeafWithConstBox> leafs;
+        if (tree_root)
+        {
+            scan_search(box, leafs, type);
+        }
+        return leafs;
+    }
+
+    /*
+    for_each_in_area() hace la misma búsqueda que find_objects(), pero
+    en lugar de juntar las hojas en un vector llama a `visit` con cada
+    LeafWithConstBox apenas la encuentra, así un resultado grande se
+    puede exportar (ver export.h) sin guardarlo entero en memoria. No
+    usa el grupo de hilos de set_query_threads().
+    */
+    template <typename Visitor>
+    void for_each_in_area(const BoundingBox &box, Visitor visit,
+                          query_type type = query_type::intersects)
+    {
+        if (tree_root)
+        {
+            find_leaf(box, visit, tree_root, type);
+        }
+    }
+
+    /*
+    find_nearest() devuelve los k valores más cercanos a `point`,
+    del más cercano al más lejano (distancia euclidiana a la geometría
+    de la hoja; 0 si el punto está dentro de su caja).
+
+    Es una búsqueda best-first: una cola de prioridad guarda nodos y
+    hojas ordenados por la distancia mínima a su caja, calculada sobre
+    las copias child_boxes del padre. Se saca siempre el elemento más
+    cercano; un nodo se expande y una hoja ya es el siguiente resultado,
+    porque ningún elemento que quede en la cola puede estar más cerca.
+    Solo se visitan los nodos cuya caja está más cerca que el k-ésimo
+    resultado. Los valores de un bucket salen juntos.
+    */
+    vector<LeafWithConstBox> find_nearest(const Point &point, size_t k)
+    {
+        vector<LeafWithConstBox> leafs;
+        if (tree_root && k > 0)
+        {
+            best_first(point, k, numeric_limits<double>::infinity(), unit_weights(), leafs);
+        }
+        return leafs;
+    }
+
+    /*
+    find_objects_within_distance() devuelve los valores cuya geometría
+    está a distancia `radius` o menos de `point`, con la distancia
+    euclidiana ponderada
+
+        d(p, q)² = Σ weights[i] · (p_i - q_i)²
+
+    Los pesos dan más importancia a unas características que a otras;
+    con todos en 1 (unit_weights()) es la distancia euclidiana. Para
+    una hoja con caja se mide hasta el punto más cercano de la caja.
+
+    En lugar de buscar la caja que rodea la esfera y filtrar después,
+    un hijo se descarta si su distancia mínima ponderada (MINDIST) pasa
+    el radio, y un subárbol cuya distancia máxima (MAXDIST) no lo pasa
+    entra entero con collect_all(), como un nodo cubierto en
+    find_leaf(). Todo se calcula sobre las copias child_boxes del
+    padre, así que las hojas se prueban con su distancia exacta sin
+    leerlas.
+
+    Con `ordered` los resultados salen del más cercano al más lejano:
+    es la búsqueda best-first de find_nearest() cortada en el radio.
+    Lanza invalid_argument si el radio o algún peso es negativo.
+    */
+    vector<LeafWithConstBox> find_objects_within_distance(const Point &point, double radius,
+                                                          const Weights &weights = unit_weights(),
+                                                          bool ordered = false)
+    {
+        if (!(radius >= 0) || any_of(weights.begin(), weights.end(), [](double w)
+                                     { return !(w >= 0); }))
+        {
+            throw invalid_argument("find_objects_within_distance: negative radius or weight");
+        }
+        vector<LeafWithConstBox> leafs;
+        if (!tree_root)
+        {
+            return leafs;
+        }
+        if (ordered)
+        {
+            best_first(point, numeric_limits<size_t>::max(), radius * radius, weights, leafs);
+        }
+        else
+        {
+            find_within(point, radius * radius, weights, tree_root, leafs);
+        }
+        return leafs;
+    }
+
+    static Weights unit_weights()
+    {
+        Weights weights;
+        weights.fill(1);
+        return weights;
+    }
+
+private:
+    /*
+    best_first() es el recorrido de find_nearest(): junta hasta k
+    valores en orden de distancia, sin pasar de `limit` (la distancia
+    al cuadrado).
+    */
+    void best_first(const Point &point, size_t k, double limit, const Weights &weights,
+                    vector<LeafWithConstBox> &leafs)
+    {
+        struct Candidate
+        {
+            double distance;
+            TreePart *part;
+            bool is_leaf;
+            bool operator<(const Candidate &rhs) const { return distance > rhs.distance; }
+        };
+        priority_queue<Candidate> queue;
+        queue.push({0, tree_root, false});
+        while (!queue.empty() && leafs.size() < k && queue.top().distance <= limit)
+        {
+            Candidate next = queue.top();
+            queue.pop();
+            if (next.is_leaf)
+            {
+                Leaf *leaf = static_cast<Leaf *>(next.part);
+                for (size_t slot = 0; slot < leaf->count() && leafs.size() < k; slot++)
+                {
+                    leafs.emplace_back(leaf, slot);
+                }
+                continue;
+            }
+            Node *node = static_cast<Node *>(next.part);
+            for (size_t i = 0; i < node->items.size(); i++)
+            {
+                double distance = child_distance(node->child_boxes[i], point, weights);
+                if (distance <= limit)
+                {
+                    queue.push({distance, node->items[i], node->hasleaves});
+                }
+            }
+        }
+    }
+
+    void find_within(const Point &point, double limit, const Weights &weights, Node *node,
+                     vector<LeafWithConstBox> &leafs)
+    {
+        for (size_t i = 0; i < node->items.size(); i++)
+        {
+            const ChildBox &child = node->child_boxes[i];
+            if (child_distance(child, point, weights, limit) > limit)
+            {
+                continue;
+            }
+            if (node->hasleaves)
+            {
+                push_values(leafs, static_cast<Leaf *>(node->items[i]));
+            }
+            else if (child_max_distance(child, point, weights) <= limit)
+            {
+                collect_all(leafs, static_cast<Node *>(node->items[i]));
+            }
+            else
+            {
+                find_within(point, limit, weights, static_cast<Node *>(node->items[i]), leafs);
+            }
+        }
+    }
+
+public:
+
+    /*
+    Búsquedas paralelas. set_query_threads(n) crea un WorkStealingPool
+    de n hilos (con 0 o 1 se elimina y todo vuelve a ser secuencial).
+    Por defecto no hay grupo: se activa solo donde `benchmark
+    parallelquery` muestre que el camino paralelo gana.
+
+    Con el grupo activo, search() empieza recorriendo el árbol en el
+    mismo hilo, con una pila de nodos pendientes (la frontera) y la
+    misma poda que find_leaf(). Una consulta pequeña termina antes de
+    visitar parallel_query_threshold nodos y nunca toca el grupo. Si
+    llega a ese número, los nodos que quedan en la frontera pasan a ser
+    tareas del grupo; una tarea sobre un nodo alto crea a su vez una
+    tarea por cada hijo que puede tener resultados, así los hilos
+    libres pueden robar trabajo. Cada worker junta sus resultados en su
+    propio búfer y al final los búferes se concatenan. El resultado es
+    el mismo conjunto que en la versión secuencial, aunque en otro
+    orden.
+    */
+    void set_query_threads(unsigned threads)
+    {
+        query_pool.reset(threads > 1 ? new WorkStealingPool(threads) : nullptr);
+    }
+
+
+    /*
+    delete_objects_in_area() es un método que elimina objetos
+    dentro de un área específica. Toma como argumento un cuadro
+    delimitador (BoundingBox).
+    Dentro de esta función:
+
+        * función delete_leafs() para eliminar las hojas que se
+        encuentran dentro del área especificada del árbol.
+    */
+    void delete_objects_in_area(const BoundingBox &box)
+    {
+        version_++;
+        if (!tree_root)
+            return;
+        delete_leafs(box, tree_root);
+    }
+
+    /*
+    update() cambia la geometría de un valor sin borrarlo e insertarlo
+    otra vez. `handle` es una hoja devuelta por una búsqueda
+    (find_objects(), find_nearest(), ...) y, como el token de
+    QueryCursor, solo vale mientras el árbol no se modifique.
+
+    La hoja conoce su nodo (parent, ver TreePart), así que no hace
+    falta buscarla bajando desde la raíz.
+
+    * Si la hoja tiene un solo valor y la geometría nueva cabe en la
+    caja de su nodo, se cambia en el lugar y solo se recalculan las
+    cajas de los ancestros, de abajo hacia arriba, hasta el primer nodo cuya
+    caja no cambió (al mover la hoja la caja puede achicarse). No hay
+    divisiones ni reinserciones, y tampoco se busca otra hoja con la
+    misma geometría para agrupar el valor en su bucket.
+    * Si no cabe, la hoja se saca de su nodo con detach_leaf(), que
+    reinserta las hojas de los nodos que quedan con menos de
+    min_child_items hijos, y se vuelve a insertar desde la raíz con
+    choose_leaf_and_insert(); si bucket_duplicates está activo y ya
+    hay una hoja con esa geometría, el valor pasa a su bucket. Un valor
+    agrupado en un bucket siempre sale del bucket por este camino.
+
+    Devuelve la hoja en su nueva posición y lanza invalid_argument si
+    `handle` no pertenece al árbol.
+    */
+    LeafWithConstBox update(const LeafWithConstBox &handle, const LeafGeometry &new_box)
+    {
+        Leaf *leaf = handle.leaf;
+        if (!leaf || !tree_root || handle.slot >= leaf->count() || !is_linked(leaf))
+        {
+            throw invalid_argument("update: the leaf is not in the tree");
+        }
+        version_++;
+        Node *owner = leaf->parent;
+        mark_dirty(owner);
+        if (leaf->count() == 1 && owner->box.contains(new_box))
+        {
+            leaf->box = new_box;
+            tighten_up(owner);
+            return LeafWithConstBox(leaf, 0);
+        }
+        Leaf *moved;
+        if (leaf->count() > 1)
+        { // the value leaves the bucket, the shared box stays
+            moved = new Leaf;
+            moved->value = take_value(leaf, handle.slot);
+        }
+        else
+        {
+            moved = leaf;
+            detach_leaf(leaf);
+        }
+        moved->box = new_box;
+        Node *twin_owner = nullptr;
+        Leaf *twin = bucket_duplicates ? find_equal_leaf(new_box, tree_root, twin_owner) : nullptr;
+        if (twin)
+        {
+            twin->bucket.push_back(moved->value);
+            mark_dirty(twin_owner);
+            index_value(twin->bucket.back(), twin);
+            free_leaf(moved);
+            return LeafWithConstBox(twin, twin->count() - 1);
+        }
+        index_value(moved->value, moved);
+        choose_leaf_and_insert(moved, tree_root);
+        used_deeps.clear();
+        return LeafWithConstBox(moved, 0);
+    }
+
+    /*
+    Índice por clave. enable_key_index(key_of) crea una tabla hash de
+    la clave de cada valor (key_of(valor), por ejemplo el id del
+    paciente) a la hoja que lo guarda. La clave es el handle estable
+    del valor: a diferencia de un LeafWithConstBox sigue valiendo
+    después de divisiones, reinserciones, relayout() o load(), porque
+    el índice se actualiza en cada sitio que crea, mueve o libera hojas.
+
+    * insert() devuelve la clave del valor insertado y rechaza con
+    invalid_argument una clave repetida, sin modificar el árbol.
+    * find_key() da la hoja y la posición del valor en su bucket.
+    * erase_key() y update_key() van de la hoja a su nodo con parent
+    y de ahí hacia la raíz, sin ninguna búsqueda espacial; los nodos
+    que quedan con menos de min_child_items hijos se condensan (ver
+    detach_leaf()).
+    delete_objects_in_area() también borra del índice lo que elimina.
+
+    Las claves deben ser únicas; si no lo son, enable_key_index() lanza
+    invalid_argument y deja el índice desactivado. Cuesta una entrada
+    de la tabla por valor.
+    */
+    void enable_key_index(function<Handle(const LeafType &)> key_of_value)
+    {
+        key_of = move(key_of_value);
+        rebuild_key_index();
+    }
+
+    void disable_key_index()
+    {
+        key_of = nullptr;
+        key_index.clear();
+    }
+
+    bool has_key_index() const { return bool(key_of); }
+
+    bool find_key(Handle key, LeafWithConstBox &out) const
+    {
+        auto entry = key_index.find(key);
+        if (entry == key_index.end())
+        {
+            return false;
+        }
+        out = LeafWithConstBox(entry->second, slot_of_key(entry->second, key));
+        return true;
+    }
+
+    bool update_key(Handle key, const LeafGeometry &new_box)
+    {
+        LeafWithConstBox handle(nullptr);
+        if (!find_key(key, handle))
+        {
+            return false;
+        }
+        update(handle, new_box);
+        return true;
+    }
+
+    bool erase_key(Handle key)
+    {
+        auto entry = key_index.find(key);
+        if (entry == key_index.end())
+        {
+            return false;
+        }
+        Leaf *leaf = entry->second;
+        key_index.erase(entry);
+        size_--;
+        version_++;
+        mark_dirty(leaf->parent);
+        if (leaf->count() > 1)
+        {
+            take_value(leaf, slot_of_key(leaf, key));
+        }
+        else
+        {
+            detach_leaf(leaf);
+            free_leaf(leaf);
+        }
+        return true;
+    }
+
+    /*
+    QueryCursor es un cursor perezoso sobre una búsqueda por área.
+    En lugar de recorrer toda la región como find_objects_in_area(),
+    guarda una pila explícita de marcos (nodo, siguiente hijo a revisar)
+    y entrega las hojas una por una con next().
+
+    * El cursor acepta el mismo query_type que find_objects() y, al
+    igual que find_leaf(), entrega sin más pruebas los subárboles
+    cubiertos por el área de búsqueda.
+    * limit(n) fija cuántas hojas puede entregar el cursor; al llegar
+    al límite next() devuelve false aunque queden resultados.
+    * token() serializa la posición actual (versión del árbol, área de
+    búsqueda, el valor pendiente dentro de una hoja agrupada y el índice
+    de cada marco de la pila) en un texto.
+    * resume_cursor(token) reconstruye la pila bajando desde la raíz
+    con esos índices, de modo que la página N+1 continúa donde terminó
+    la página N sin repetir la búsqueda.
+
+    El token solo es válido mientras el árbol no se modifique: cada
+    insert() o delete_objects_in_area() incrementa version_, y un token
+    de otra versión se rechaza con invalid_argument.
+    */
+    class QueryCursor
+    {
+    public:
+        QueryCursor(RStarTree *tree_, const BoundingBox &box_,
+                    query_type type_ = query_type::intersects)
+            : tree(tree_), box(box_), type(type_), version(tree_->version_)
+        {
+            if (tree->tree_root)
+            {
+                stack.push_back({tree->tree_root, 0,
+                                 is_covered(box, tree->tree_root->box, type)});
+            }
+        }
+
+        QueryCursor &limit(size_t n)
+        {
+            max_results = yielded + n;
+            return *this;
+        }
+
+        bool next(LeafWithConstBox &out)
+        {
+            if (version != tree->version_)
+            {
+                throw invalid_argument("QueryCursor: tree was modified");
+            }
+            while (!stack.empty() && yielded < max_results)
+            {
+                Frame &top = stack.back();
+                if (top.index >= top.node->items.size())
+                { // every child of this node was visited
+                    stack.pop_back();
+                    continue;
+                }
+                TreePart *item = top.node->items[top.index];
+                if (top.node->hasleaves)
+                {
+                    Leaf *leaf = static_cast<Leaf *>(item);
+                    if (slot > 0 || top.covered ||
+                        (child_may_match(top.node->child_boxes[top.index], box, type) &&
+                         leaf_matches(box, leaf->box, type)))
+                    { // a bucketed leaf is handed out one value per call
+                        out = LeafWithConstBox(leaf, slot);
+                        yielded++;
+                        if (++slot >= leaf->count())
+                        {
+                            slot = 0;
+                            top.index++;
+                        }
+                        return true;
+                    }
+                    top.index++;
+                    continue;
+                }
+                top.index++;
+                if (top.covered)
+                {
+                    stack.push_back({static_cast<Node *>(item), 0, true});
+                }
+                else if (child_may_match(top.node->child_boxes[top.index - 1], box, type))
+                {
+                    Node *child = static_cast<Node *>(item);
+                    stack.push_back({child, 0, is_covered(box, child->box, type)});
+                }
+            }
+            return false;
+        }
+
+        bool exhausted() const { return stack.empty(); }
+        size_t count() const { return yielded; }
+        const BoundingBox &get_box() const { return box; }
+
+        string token() const
+        {
+            ostringstream out;
+            out.precision(17);
+            out << version << ';' << static_cast<int>(type) << ';' << slot << ';';
+            for (size_t axis = 0; axis < dimensions; axis++)
+            {
+                out << box.min_edges[axis] << ',' << box.max_edges[axis] << ';';
+            }
+            for (size_t i = 0; i < stack.size(); i++)
+            {
+                out << (i ? "," : "") << stack[i].index;
+            }
+            return out.str();
+        }
+
+    private:
+        friend class RStarTree;
+
+        struct Frame
+        {
+            Node *node;
+            size_t index; //<next child of node to be tested
+            bool covered; //<node box lies inside the query window
+        };
+
+        RStarTree *tree;
+        BoundingBox box;
+        query_type type;
+        size_t version;
+        vector<Frame> stack;
+        size_t slot{0}; //<next value inside the current bucketed leaf
+        size_t yielded{0};
+        size_t max_results{numeric_limits<size_t>::max()};
+    };
+
+    QueryCursor open_cursor(const BoundingBox &box,
+                            query_type type = query_type::intersects)
+    {
+        return QueryCursor(this, box, type);
+    }
+
+    /*
+    resume_cursor() interpreta un token producido por
+    QueryCursor::token(). Recupera el área de búsqueda y baja desde la
+    raíz siguiendo los índices guardados: el nodo del marco k es el
+    hijo (índice - 1) del marco k - 1, porque el índice de un marco ya
+    apunta al hijo siguiente al que se descendió. Solo el marco de hojas
+    puede apuntar a una hoja agrupada a medio entregar (`slot`).
+    */
+    QueryCursor resume_cursor(const string &token)
+    {
+        istringstream in(token);
+        string field;
+        // Numbers are parsed with stod()/stoull(), which also read the
+        // "inf" and "-inf" that token() writes for unbounded edges.
+        auto next_field = [&in, &field](char separator) -> const string &
+        {
+            if (!getline(in, field, separator))
+            {
+                throw invalid_argument("resume_cursor: malformed token");
+            }
+            return field;
+        };
+        size_t version, slot;
+        int type;
+        BoundingBox box;
+        try
+        {
+            version = stoull(next_field(';'));
+            type = stoi(next_field(';'));
+            slot = stoull(next_field(';'));
+            for (size_t axis = 0; axis < dimensions; axis++)
+            {
+                box.min_edges[axis] = stod(next_field(','));
+                box.max_edges[axis] = stod(next_field(';'));
+            }
+        }
+        catch (const out_of_range &)
+        {
+            throw invalid_argument("resume_cursor: malformed token");
+        }
+        if (type < 0 || type > static_cast<int>(query_type::overlaps))
+        {
+            throw invalid_argument("resume_cursor: malformed token");
+        }
+        if (version != version_)
+        {
+            throw invalid_argument("resume_cursor: stale or malformed token");
+        }
+        QueryCursor cursor(this, box, static_cast<query_type>(type));
+        cursor.stack.clear();
+        cursor.slot = slot;
+        Node *node = tree_root;
+        bool covered = false;
+        while (getline(in, field, ','))
+        {
+            size_t index;
+            try
+            {
+                index = stoull(field);
+            }
+            catch (const out_of_range &)
+            {
+                throw invalid_argument("resume_cursor: malformed token");
+            }
+            if (!node || index > node->items.size())
+            {
+                throw invalid_argument("resume_cursor: malformed token");
+            }
+            covered = covered || is_covered(cursor.box, node->box, cursor.type);
+            cursor.stack.push_back({node, index, covered});
+            node = (index > 0 && !node->hasleaves)
+                       ? static_cast<Node *>(node->items[index - 1])
+                       : nullptr;
+        }
+        return cursor;
+    }
+
+
+
+private:
+    void write_node(Node *node, ostream &file)
+    {
+        size_t _size = node->items.size();
+        file.write(reinterpret_cast<const char *>(&_size), sizeof(_size));
+        file.write(reinterpret_cast<const char *>(&(node->hasleaves)),
+                   sizeof(node->hasleaves));
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            file.write(reinterpret_cast<const char *>(&(node->box.max_edges[axis])),
+                       sizeof(node->box.max_edges[axis]));
+            file.write(reinterpret_cast<const char *>(&(node->box.min_edges[axis])),
+                       sizeof(node->box.min_edges[axis]));
+        }
+    }
+
+    void write_geometry(BoundingBox &box, ostream &file)
+    {
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            file.write(reinterpret_cast<char *>(&(box.max_edges[axis])),
+                       sizeof(box.max_edges[axis]));
+            file.write(reinterpret_cast<char *>(&(box.min_edges[axis])),
+                       sizeof(box.min_edges[axis]));
+        }
+    }
+
+    void write_geometry(Point &point, ostream &file)
+    {
+        file.write(reinterpret_cast<char *>(point.coords.data()), sizeof(point.coords));
+    }
+
+    void read_geometry(BoundingBox &box, istream &file)
+    {
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            file.read(reinterpret_cast<char *>(&(box.max_edges[axis])),
+                      sizeof(box.max_edges[axis]));
+            file.read(reinterpret_cast<char *>(&(box.min_edges[axis])),
+                      sizeof(box.min_edges[axis]));
+        }
+    }
+
+    void read_geometry(Point &point, istream &file)
+    {
+        file.read(reinterpret_cast<char *>(point.coords.data()), sizeof(point.coords));
+    }
+
+    void write_leaf(Leaf *leaf, ostream &file)
+    {
+        write_geometry(leaf->box, file);
+        file.write(reinterpret_cast<char *>(&(leaf->value)), sizeof(LeafType));
+        size_t bucket_size = leaf->bucket.size();
+        file.write(reinterpret_cast<char *>(&bucket_size), sizeof(bucket_size));
+        file.write(reinterpret_cast<char *>(leaf->bucket.data()),
+                   bucket_size * sizeof(LeafType));
+    }
+
+    Node *read_node(istream &file)
+    {
+        size_t _size;
+        file.read(reinterpret_cast<char *>(&_size), sizeof(_size));
+        Node *new_node = new Node;
+        new_node->items.resize(_size);
+        file.read(reinterpret_cast<char *>(&(new_node->hasleaves)),
+                  sizeof(new_node->hasleaves));
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            file.read(reinterpret_cast<char *>(&(new_node->box.max_edges[axis])),
+                      sizeof(new_node->box.max_edges[axis]));
+            file.read(reinterpret_cast<char *>(&(new_node->box.min_edges[axis])),
+                      sizeof(new_node->box.min_edges[axis]));
+        }
+        return new_node;
+    }
+
+    Leaf *read_leaf(istream &file)
+    {
+        Leaf *new_leaf = new Leaf;
+        read_geometry(new_leaf->box, file);
+        file.read(reinterpret_cast<char *>(&(new_leaf->value)), sizeof(LeafType));
+        size_t bucket_size;
+        file.read(reinterpret_cast<char *>(&bucket_size), sizeof(bucket_size));
+        new_leaf->bucket.resize(bucket_size);
+        file.read(reinterpret_cast<char *>(new_leaf->bucket.data()),
+                  bucket_size * sizeof(LeafType));
+        size_ += new_leaf->count();
+        return new_leaf;
+    }
+
+    static constexpr uint64_t snapshot_magic = 0x31544e5352545352; // "RSTRSNT1"
+
+    static constexpr uint64_t page_layout()
+    {
+        return uint64_t(dimensions) | uint64_t(sizeof(LeafType)) << 16 |
+               uint64_t(point_leaves) << 48;
+    }
+
+    void forget_pages()
+    {
+        dirty_nodes.clear();
+        page_bytes.clear();
+        live_page_bytes = 0;
+        next_page = 1;
+        pages_path.clear();
+    }
+
+    void forget_subtree_pages(Node *node)
+    {
+        node->page = 0;
+        node->dirty = false;
+        if (!node->hasleaves)
+        {
+            for (TreePart *item : node->items)
+                forget_subtree_pages(static_cast<Node *>(item));
+        }
+    }
+
+    // Writes `node` and the children that have no page yet; returns the pages written.
+    size_t write_page(Node *node, PageFile &file)
+    {
+        size_t written = 1;
+        if (node->page == 0)
+        {
+            node->page = next_page++;
+        }
+        node->dirty = false;
+        ostringstream payload;
+        write_node(node, payload);
+        for (TreePart *item : node->items)
+        {
+            if (node->hasleaves)
+            {
+                write_leaf(static_cast<Leaf *>(item), payload);
+                continue;
+            }
+            Node *child = static_cast<Node *>(item);
+            if (child->page == 0)
+            {
+                written += write_page(child, file);
+            }
+            payload.write(reinterpret_cast<const char *>(&child->page), sizeof(child->page));
+        }
+        string bytes = payload.str();
+        file.append_page(node->page, bytes);
+        uint64_t &live = page_bytes[node->page];
+        live_page_bytes += bytes.size() + 12 - live;
+        live = bytes.size() + 12;
+        return written;
+    }
+
+    Node *read_page_subtree(uint32_t page, const PageTable &state, PageFile &file)
+    {
+        auto entry = state.pages.find(page);
+        if (entry == state.pages.end())
+        {
+            throw invalid_argument("load_pages: missing page");
+        }
+        istringstream in(file.read_page(page, entry->second));
+        Node *node = read_node(in);
+        size_t children = node->items.size();
+        node->items.clear();
+        if (!in || children > max_child_items)
+        {
+            delete node;
+            throw invalid_argument("load_pages: truncated or malformed checkpoint");
+        }
+        node->page = page;
+        page_bytes[page] = entry->second.bytes + 12;
+        live_page_bytes += entry->second.bytes + 12;
+        try
+        {
+            for (size_t i = 0; i < children; i++)
+            {
+                if (node->hasleaves)
+                {
+                    node->items.push_back(read_leaf(in));
+                }
+                else
+                {
+                    uint32_t child = 0;
+                    in.read(reinterpret_cast<char *>(&child), sizeof(child));
+                    if (!in)
+                        throw invalid_argument("load_pages: truncated or malformed checkpoint");
+                    node->items.push_back(read_page_subtree(child, state, file));
+                }
+                if (!in)
+                    throw invalid_argument("load_pages: truncated or malformed checkpoint");
+            }
+        }
+        catch (...)
+        {
+            delete_tree(node);
+            throw;
+        }
+        refresh_box(node);
+        return node;
+    }
+
+    void write_subtree(Node *node, ostream &file)
+    {
+        write_node(node, file);
+        for (TreePart *item : node->items)
+        {
+            if (node->hasleaves)
+                write_leaf(static_cast<Leaf *>(item), file);
+            else
+                write_subtree(static_cast<Node *>(item), file);
+        }
+    }
+
+    // On a malformed stream the partial subtree is freed before throwing.
+    Node *read_subtree(istream &file)
+    {
+        Node *node = read_node(file);
+        size_t children = node->items.size();
+        node->items.clear();
+        if (!file || children > max_child_items)
+        {
+            delete node;
+            throw invalid_argument("load: truncated or malformed snapshot");
+        }
+        try
+        {
+            for (size_t i = 0; i < children; i++)
+            {
+                if (node->hasleaves)
+                {
+                    Leaf *leaf = read_leaf(file);
+                    node->items.push_back(leaf);
+                    if (!file)
+                        throw invalid_argument("load: truncated or malformed snapshot");
+                }
+                else
+                {
+                    node->items.push_back(read_subtree(file));
+                }
+            }
+        }
+        catch (...)
+        {
+            delete_tree(node);
+            throw;
+        }
+        refresh_box(node);
+        return node;
+    }
+
+    /*
+    La función `find_leaf` es crucial en la búsqueda de hojas
+    dentro del árbol R-Star que están contenidas dentro de un área
+    determinada (`BoundingBox`). Aquí está su desglose:
+
+    - `void find_leaf(const BoundingBox &box,
+    vector<LeafWithConstBox> &leafs, Node *node)`:
+    Esta función toma tres argumentos:
+        - `box`: El área de búsqueda representada por
+        un cuadro delimitador.
+        - `leafs`: Un vector que almacenará las hojas
+        encontradas dentro del área.
+        - `node`: El nodo actual en el que se está buscando.
+
+    La función opera de la siguiente manera:
+
+    - Verifica si el nodo actual contiene hojas (`node->hasleaves`).
+    Si es así, itera a través de las hojas presentes en ese nodo.
+        - Para cada hoja, se convierte el elemento del nodo a un puntero `Leaf`.
+        - Comprueba si la caja delimitadora de esa hoja (`temp_leaf->box`)
+        se intersecta con el área de búsqueda (`box`).
+        - Si hay una intersección, agrega esa hoja al vector `leafs`.
+
+    - Si el nodo actual no contiene hojas (`node->hasleaves` es falso),
+    significa que contiene nodos secundarios.
+        - Itera a través de los nodos secundarios presentes en el
+        nodo actual.
+        - Para cada nodo secundario, se convierte el elemento del nodo
+        a un puntero `Node`.
+        - Comprueba si la caja delimitadora de ese nodo secundario
+        (`temp_node->box`) se intersecta con el área de búsqueda (`box`).
+        - Si hay una intersección, se llama recursivamente a
+        `find_leaf()` con ese nodo secundario como nuevo nodo actual.
+
+    Este proceso continúa hasta que se recorren todos los nodos del árbol
+    y se encuentran todas las hojas que se superponen con el área de búsqueda.
+    Las hojas encontradas se almacenan en el vector `leafs`, que luego se
+    devuelve a la función que la llamó.
+
+    El parámetro `type` elige el predicado de las hojas (intersects,
+    within o contains). Para los nodos internos se usa la prueba
+    node_may_match(), y cuando la caja de un nodo queda completamente
+    dentro del área de búsqueda (is_covered()) todo su subárbol se
+    agrega con collect_all() sin ninguna prueba de cajas adicional.
+
+    `leafs` puede ser también una función: for_each_in_area() la usa
+    para recibir cada hoja sin guardar el resultado.
+    */
+    template <typename Output>
+    void find_leaf(const BoundingBox &box, Output &leafs,
+                   Node *node, query_type type = query_type::intersects)
+    {
+        if (is_covered(box, node->box, type))
+        {
+            collect_all(leafs, node);
+            return;
+        }
+        if (node->hasleaves)
+        {
+            for (size_t i = 0; i < node->items.size(); i++)
+            {
+                if (!child_may_match(node->child_boxes[i], box, type))
+                {
+                    continue;
+                }
+                Leaf *temp_leaf = static_cast<Leaf *>(node->items[i]);
+                if (leaf_matches(box, temp_leaf->box, type))
+                {
+                    push_values(leafs, temp_leaf);
+                }
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < node->items.size(); i++)
+            {
+                if (child_may_match(node->child_boxes[i], box, type))
+                {
+                    find_leaf(box, leafs, static_cast<Node *>(node->items[i]), type);
+                }
+            }
+        }
+    }
+
+    void search(const BoundingBox &box, vector<LeafWithConstBox> &leafs, query_type type)
+    {
+        if (!tree_root)
+        {
+            return;
+        }
+        if (planner)
+        {
+            QueryPlan plan = plan_query(box, type);
+            leafs.reserve(leafs.size() + min(size_, size_t(plan.estimated_results * 1.25) + 16));
+            if (plan.scan)
+            {
+                scan_search(box, leafs, type);
+                return;
+            }
+        }
+        if (!query_pool)
+        {
+            find_leaf(box, leafs, tree_root, type);
+            return;
+        }
+        vector<Node *> frontier{tree_root};
+        for (size_t visited = 0; !frontier.empty() && visited < parallel_query_threshold; visited++)
+        {
+            Node *node = frontier.back();
+            frontier.pop_back();
+            if (node->hasleaves)
+            {
+                find_leaf(box, leafs, node, type);
+                continue;
+            }
+            push_matching_children(box, node, type, frontier);
+        }
+        if (frontier.empty())
+        { // small query: it ended on the sequential path
+            return;
+        }
+        vector<vector<LeafWithConstBox>> buffers(query_pool->size());
+        query_pool->run([&](unsigned worker)
+                        {
+                            for (Node *node : frontier)
+                            {
+                                spawn_search(box, node, type, buffers, worker);
+                            } });
+        size_t total = leafs.size();
+        for (auto &buffer : buffers)
+        {
+            total += buffer.size();
+        }
+        leafs.reserve(total);
+        for (auto &buffer : buffers)
+        {
+            leafs.insert(leafs.end(), buffer.begin(), buffer.end());
+        }
+    }
+
+    /*
+    Estadísticas de analyze(). LevelStats resume un nivel del árbol
+    (0 es la raíz): nodos, hijos y la suma por eje de los lados de las
+    cajas de sus nodos. SelectivityStats guarda los niveles, el
+    histograma (cells, side divisiones por eje sobre bounds, con el
+    eje 0 como el que varía más rápido), los histogramas por eje como
+    sumas acumuladas (marginal[axis][i] son los valores de los
+    primeros i intervalos), la separación entre valores de cada eje
+    discreto (0 en los continuos) y la versión y el tamaño del árbol
+    analizado.
+    */
+    static constexpr size_t marginal_bins = 64;
+
+    struct LevelStats
+    {
+        size_t nodes{0};
+        size_t children{0};
+        array<double, dimensions> side{};
+    };
+
+    struct SelectivityStats
+    {
+        size_t version{numeric_limits<size_t>::max()};
+        size_t values{0};
+        size_t leaves{0};
+        vector<LevelStats> levels;
+        BoundingBox bounds;
+        size_t side{1};
+        vector<uint32_t> cells;
+        array<double, dimensions> spacing{};
+        array<array<double, marginal_bins + 1>, dimensions> marginal{}; //<prefix sums per axis
+    };
+
+    // Values of `axis` in [lo, hi], uniform inside each marginal bin.
+    static double axis_mass(const SelectivityStats &stats, size_t axis, double lo, double hi)
+    {
+        const auto &prefix = stats.marginal[axis];
+        double low = stats.bounds.min_edges[axis];
+        double width = (stats.bounds.max_edges[axis] - low) / double(marginal_bins);
+        if (width <= 0)
+        {
+            return prefix[marginal_bins];
+        }
+        auto below = [&](double x)
+        { // values in [low, x]
+            double position = min(max((x - low) / width, 0.0), double(marginal_bins));
+            size_t bin = min(size_t(position), marginal_bins - 1);
+            return prefix[bin] + (prefix[bin + 1] - prefix[bin]) * (position - double(bin));
+        };
+        return max(0.0, below(hi) - below(lo));
+    }
+
+    static double center_of(const LeafGeometry &geometry, size_t axis)
+    {
+        if constexpr (point_leaves)
+        {
+            return geometry.coords[axis];
+        }
+        else
+        {
+            return (geometry.min_edges[axis] + geometry.max_edges[axis]) / 2;
+        }
+    }
+
+    void analyze_node(const Node *node, size_t depth, SelectivityStats &stats,
+                      array<unordered_set<double>, dimensions> &distinct) const
+    {
+        if (stats.levels.size() <= depth)
+        {
+            stats.levels.resize(depth + 1);
+        }
+        LevelStats &level = stats.levels[depth];
+        level.nodes++;
+        level.children += node->items.size();
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            level.side[axis] += node->box.max_edges[axis] - node->box.min_edges[axis];
+        }
+        if (!node->hasleaves)
+        {
+            for (size_t i = 0; i < node->items.size(); i++)
+            {
+                analyze_node(static_cast<const Node *>(node->items[i]), depth + 1, stats, distinct);
+            }
+            return;
+        }
+        for (size_t i = 0; i < node->items.size(); i++)
+        {
+            const Leaf *leaf = static_cast<const Leaf *>(node->items[i]);
+            size_t index = 0;
+            for (size_t axis = dimensions; axis-- > 0;)
+            {
+                double value = center_of(leaf->box, axis);
+                double low = stats.bounds.min_edges[axis];
+                double width = (stats.bounds.max_edges[axis] - low) / double(stats.side);
+                size_t cell = width > 0 ? min(size_t(max(0.0, (value - low) / width)), stats.side - 1) : 0;
+                index = index * stats.side + cell;
+                double bin_width = (stats.bounds.max_edges[axis] - low) / double(marginal_bins);
+                size_t bin = bin_width > 0 ? min(size_t(max(0.0, (value - low) / bin_width)), marginal_bins - 1) : 0;
+                stats.marginal[axis][bin + 1] += double(leaf->count());
+                if (distinct[axis].size() <= 256)
+                {
+                    distinct[axis].insert(value);
+                }
+            }
+            stats.cells[index] += uint32_t(leaf->count());
+            stats.leaves++;
+        }
+    }
+
+    // Analyzes again once a quarter of the tree changed since the last analyze().
+    void refresh_selectivity()
+    {
+        const SelectivityStats &stats = selectivity;
+        if (stats.version == version_)
+        {
+            return;
+        }
+        size_t drift = max(stats.values, size_) - min(stats.values, size_);
+        if (stats.version == numeric_limits<size_t>::max() ||
+            4 * max(drift, version_ - stats.version) > stats.values)
+        {
+            analyze();
+        }
+    }
+
+    // Packs the geometry of every leaf, axis by axis, for scan_search().
+    void refresh_scan()
+    {
+        if (scan_version_ == version_)
+        {
+            return;
+        }
+        scan_leaves.clear();
+        walk_leaves(tree_root);
+        const size_t n = scan_leaves.size();
+        scan_lo.resize(dimensions * n);
+        scan_hi.resize(point_leaves ? 0 : dimensions * n);
+        for (size_t row = 0; row < n; row++)
+        {
+            const LeafGeometry &geometry = scan_leaves[row]->box;
+            for (size_t axis = 0; axis < dimensions; axis++)
+            {
+                if constexpr (point_leaves)
+                {
+                    scan_lo[axis * n + row] = geometry.coords[axis];
+                }
+                else
+                {
+                    scan_lo[axis * n + row] = geometry.min_edges[axis];
+                    scan_hi[axis * n + row] = geometry.max_edges[axis];
+                }
+            }
+        }
+        scan_version_ = version_;
+    }
+
+    void walk_leaves(Node *node)
+    {
+        for (size_t i = 0; i < node->items.size(); i++)
+        {
+            if (node->hasleaves)
+                scan_leaves.push_back(static_cast<Leaf *>(node->items[i]));
+            else
+                walk_leaves(static_cast<Node *>(node->items[i]));
+        }
+    }
+
+    /*
+    scan_search() prueba cada bloque de filas eje por eje con
+    mask &= (a >= x) & (b <= y), donde a y b son los bordes de las
+    hojas y x, y los de la ventana que corresponden al predicado:
+    intersects y overlaps usan la prueba touches() (bordes que se tocan
+    incluidos) y confirman las hojas con caja con leaf_matches(), within
+    y contains sus definiciones. Para hojas puntuales los dos bordes son
+    el mismo arreglo.
+    */
+    template <typename Output>
+    void scan_search(const BoundingBox &box, Output &leafs, query_type type)
+    {
+        refresh_scan();
+        constexpr size_t block = 256;
+        const size_t n = scan_leaves.size();
+        const double *low = scan_lo.data();
+        const double *high = point_leaves ? low : scan_hi.data();
+        const double *a = type == query_type::within ? low : high;
+        const double *b = type == query_type::within ? high : low;
+        uint8_t mask[block];
+        for (size_t start = 0; start < n; start += block)
+        {
+            const size_t count = min(block, n - start);
+            fill(mask, mask + count, uint8_t(1));
+            for (size_t axis = 0; axis < dimensions; axis++)
+            {
+                const double x = type == query_type::contains ? box.max_edges[axis] : box.min_edges[axis];
+                const double y = type == query_type::contains ? box.min_edges[axis] : box.max_edges[axis];
+                const double *first = a + axis * n + start;
+                const double *second = b + axis * n + start;
+                for (size_t row = 0; row < count; row++)
+                {
+                    mask[row] &= uint8_t((first[row] >= x) & (second[row] <= y));
+                }
+            }
+            for (size_t row = 0; row < count; row++)
+            {
+                if (!mask[row])
+                    continue;
+                Leaf *leaf = scan_leaves[start + row];
+                if (point_leaves || type == query_type::within || type == query_type::contains ||
+                    leaf_matches(box, leaf->box, type))
+                {
+                    push_values(leafs, leaf);
+                }
+            }
+        }
+    }
+
+    // Children of an inner node that may hold results (all of them if it is covered).
+    void push_matching_children(const BoundingBox &box, Node *node, query_type type,
+                                vector<Node *> &out)
+    {
+        bool covered = is_covered(box, node->box, type);
+        for (size_t i = 0; i < node->items.size(); i++)
+        {
+            if (covered || child_may_match(node->child_boxes[i], box, type))
+            {
+                out.push_back(static_cast<Node *>(node->items[i]));
+            }
+        }
+    }
+
+    // A task per subtree; nodes two levels above the leaves are split
+    // into one task per child, lower nodes are searched in one go.
+    void spawn_search(const BoundingBox &box, Node *node, query_type type,
+                      vector<vector<LeafWithConstBox>> &buffers, unsigned worker)
+    {
+        query_pool->spawn(worker, [this, &box, node, type, &buffers](unsigned w)
+                          {
+                              if (node->hasleaves ||
+                                  static_cast<Node *>(node->items.front())->hasleaves)
+                              {
+                                  find_leaf(box, buffers[w], node, type);
+                                  return;
+                              }
+                              vector<Node *> children;
+                              push_matching_children(box, node, type, children);
+                              for (Node *child : children)
+                              {
+                                  spawn_search(box, child, type, buffers, w);
+                              } });
+    }
+
+    /*
+    collect_all() agrega todas las hojas del subárbol de `node` sin
+    probar sus cajas. Solo se llama sobre nodos cubiertos por el área
+    de búsqueda.
+    */
+    template <typename Output>
+    void collect_all(Output &leafs, Node *node)
+    {
+        if (node->hasleaves)
+        {
+            for (size_t i = 0; i < node->items.size(); i++)
             {
-                return get_box() < rhs.get_box();
+                push_values(leafs, static_cast<Leaf *>(node->items[i]));
             }
-            return get_value() < rhs.get_value();
         }
-        bool operator==(const LeafWithConstBox &rhs) const
+        else
         {
-            return get_value() == rhs.get_value() && get_box() == rhs.get_box();
+            for (size_t i = 0; i < node->items.size(); i++)
+            {
+                collect_all(leafs, static_cast<Node *>(node->items[i]));
+            }
         }
-        bool operator!=(const LeafWithConstBox &rhs) const
+    }
+
+    // One result per value stored in the leaf, bucketed values included.
+    static void push_values(vector<LeafWithConstBox> &leafs, Leaf *leaf)
+    {
+        for (size_t slot = 0; slot < leaf->count(); slot++)
         {
-            return !operator==(rhs);
+            leafs.push_back({leaf, slot});
         }
+    }
 
-    public:
-        Leaf *leaf{nullptr};
-    };
-
-public:
-    RStarTree()
+    template <typename Visitor>
+    static void push_values(Visitor &visit, Leaf *leaf)
     {
-        if (dimensions <= 0 || max_child_items < min_child_items)
+        for (size_t slot = 0; slot < leaf->count(); slot++)
         {
-            throw invalid_argument("");
+            visit(LeafWithConstBox(leaf, slot));
         }
     }
-    ~RStarTree() { delete_tree(tree_root); }
 
     /*
-    La función insert() permite insertar una hoja en el
-    árbol. Toma como argumentos un valor de hoja (LeafType)
-     y un área delimitadora (BoundingBox).
-     Dentro de esta función:
-
-    * Se incrementa el tamaño (size_) del árbol.
-    * Se crea una nueva hoja Leaf y se le asigna el valor
-        proporcionado (leaf) y la caja delimitadora (box).
-    * Si el árbol está vacío (!tree_root), se crea un nuevo
-     nodo raíz y se inserta la hoja en él.
-    * En caso contrario, se invoca a la función
-    choose_leaf_and_insert() para encontrar el nodo
-    hoja adecuado y realizar la inserción.
-    * used_deeps.clear() se usa para limpiar un contenedor
-    (posiblemente un conjunto o un vector) llamado used_deeps.
-
+    find_equal_leaf() busca una hoja cuya geometría sea exactamente `box`.
+    Solo baja por los nodos cuya caja contiene a `box`, porque la caja
+    de un nodo siempre contiene las de sus hojas.
     */
-    void insert(const LeafType leaf, const BoundingBox &box)
+    Leaf *find_equal_leaf(const LeafGeometry &box, Node *node, Node *&owner)
     {
-        size_++;
-        Leaf *new_leaf = new Leaf;
-        new_leaf->value = leaf;
-        new_leaf->box = box;
-        if (!tree_root)
+        if (node->hasleaves)
         {
-            tree_root = new Node();
-            tree_root->hasleaves = true;
-            tree_root->items.reserve(min_child_items);
-            tree_root->items.push_back(new_leaf);
+            for (size_t i = 0; i < node->items.size(); i++)
+            {
+                if (static_cast<Leaf *>(node->items[i])->box == box)
+                {
+                    owner = node;
+                    return static_cast<Leaf *>(node->items[i]);
+                }
+            }
+            return nullptr;
         }
-        else
+        for (size_t i = 0; i < node->items.size(); i++)
         {
-            choose_leaf_and_insert(new_leaf, tree_root);
+            if (static_cast<Node *>(node->items[i])->box.contains(box))
+            {
+                if (Leaf *leaf = find_equal_leaf(box, static_cast<Node *>(node->items[i]), owner))
+                {
+                    return leaf;
+                }
+            }
         }
-        used_deeps.clear();
+        return nullptr;
     }
 
-    /*
-    find_objects_in_area() es un método que busca objetos
-    dentro de un área específica. Toma como argumento un cuadro
-    delimitador (BoundingBox). Dentro de esta función:
+    // True if `leaf` is still a child of the node it points to.
+    static bool is_linked(const Leaf *leaf)
+    {
+        Node *owner = leaf->parent;
+        return owner && owner->hasleaves &&
+               find(owner->items.begin(), owner->items.end(), leaf) != owner->items.end();
+    }
 
-    * Se crea un vector de LeafWithConstBox llamado leafs.
-    * Se llama a la función find_leaf() para buscar las hojas
-    que se encuentran dentro del área especificada. Estas hojas
-    se almacenan en el vector leafs.
-    * Retorna el vector leafs, que contiene las hojas encontradas
-    dentro del área.
-    */
-    vector<LeafWithConstBox> find_objects_in_area(const BoundingBox &box)
+    // Recomputes the boxes from `node` towards the root until one stays the same.
+    void tighten_up(Node *node)
     {
-        vector<LeafWithConstBox> leafs;
-        find_leaf(box, leafs, tree_root);
-        return leafs;
+        while (node)
+        {
+            BoundingBox before = node->box;
+            refresh_box(node);
+            if (node == tree_root || node->box == before)
+            {
+                break;
+            }
+            node = node->parent;
+        }
     }
 
     /*
-    delete_objects_in_area() es un método que elimina objetos
-    dentro de un área específica. Toma como argumento un cuadro
-    delimitador (BoundingBox).
-    Dentro de esta función:
-
-        * función delete_leafs() para eliminar las hojas que se
-        encuentran dentro del área especificada del árbol.
+    detach_leaf() saca una hoja de su nodo y condensa el camino hasta
+    la raíz, como el CondenseTree del R-tree original:
+
+    * Subiendo desde el nodo de la hoja, todo nodo que no es la raíz y
+    queda con menos de min_child_items hijos se quita de su padre; sus
+    hojas se guardan y sus nodos se liberan (dissolve()).
+    * Las cajas se recalculan desde el primer nodo que se conserva
+    hasta la raíz (tighten_up()).
+    * Una raíz interna con un solo hijo se reemplaza por ese hijo; si
+    se quedó sin hijos pasa a ser una raíz vacía de hojas.
+    * Las hojas guardadas se insertan otra vez desde la raíz con
+    choose_leaf_and_insert(). Son las mismas hojas, así que el índice
+    por clave sigue apuntando a ellas.
+
+    Así, después de update() y erase_key() ningún nodo queda con menos
+    de min_child_items hijos. delete_leafs() no condensa.
     */
-    void delete_objects_in_area(const BoundingBox &box)
+    void detach_leaf(Leaf *leaf)
     {
-        delete_leafs(box, tree_root);
+        Node *node = leaf->parent;
+        auto position = find(node->items.begin(), node->items.end(), leaf);
+        swap(*position, node->items.back());
+        node->items.pop_back();
+        mark_dirty(node);
+        vector<Leaf *> orphans;
+        while (node != tree_root && node->items.size() < min_child_items)
+        {
+            Node *parent = node->parent;
+            auto slot = find(parent->items.begin(), parent->items.end(), node);
+            swap(*slot, parent->items.back());
+            parent->items.pop_back();
+            mark_dirty(parent);
+            dissolve(node, orphans);
+            node = parent;
+        }
+        tighten_up(node);
+        while (!tree_root->hasleaves && tree_root->items.size() == 1)
+        { // a root with one child is just an extra level
+            Node *old_root = tree_root;
+            tree_root = static_cast<Node *>(old_root->items.front());
+            tree_root->parent = nullptr;
+            old_root->items.clear();
+            free_node(old_root);
+        }
+        if (!tree_root->hasleaves && tree_root->items.empty())
+        {
+            tree_root->hasleaves = true;
+            refresh_box(tree_root);
+        }
+        for (Leaf *orphan : orphans)
+        {
+            choose_leaf_and_insert(orphan, tree_root);
+            used_deeps.clear();
+        }
     }
 
+    // Frees a subtree's nodes and keeps its leaves in `orphans`.
+    void dissolve(Node *node, vector<Leaf *> &orphans)
+    {
+        for (TreePart *item : node->items)
+        {
+            if (node->hasleaves)
+                orphans.push_back(static_cast<Leaf *>(item));
+            else
+                dissolve(static_cast<Node *>(item), orphans);
+        }
+        node->items.clear();
+        free_node(node);
+    }
 
-
-private:
-    void write_node(Node *node, fstream &file)
+    // Removes the value in `slot` from a leaf that holds more than one.
+    static LeafType take_value(Leaf *leaf, size_t slot)
     {
-        size_t _size = node->items.size();
-        file.write(reinterpret_cast<const char *>(&_size), sizeof(_size));
-        file.write(reinterpret_cast<const char *>(&(node->hasleaves)),
-                   sizeof(node->hasleaves));
-        for (size_t axis = 0; axis < dimensions; axis++)
+        LeafType value = leaf->at(slot);
+        if (slot == 0)
         {
-            file.write(reinterpret_cast<const char *>(&(node->box.max_edges[axis])),
-                       sizeof(node->box.max_edges[axis]));
-            file.write(reinterpret_cast<const char *>(&(node->box.min_edges[axis])),
-                       sizeof(node->box.min_edges[axis]));
+            leaf->value = leaf->bucket.front();
+            leaf->bucket.erase(leaf->bucket.begin());
+        }
+        else
+        {
+            leaf->bucket.erase(leaf->bucket.begin() + (slot - 1));
         }
+        return value;
     }
 
-    void write_leaf(Leaf *leaf, fstream &file)
+    // Points the key of `value` at `leaf` (no-op without a key index).
+    void index_value(const LeafType &value, Leaf *leaf)
     {
-        for (size_t axis = 0; axis < dimensions; axis++)
+        if (key_of)
         {
-            file.write(reinterpret_cast<char *>(&(leaf->box.max_edges[axis])),
-                       sizeof(leaf->box.max_edges[axis]));
-            file.write(reinterpret_cast<char *>(&(leaf->box.min_edges[axis])),
-                       sizeof(leaf->box.min_edges[axis]));
+            key_index[key_of(value)] = leaf;
         }
-        file.write(reinterpret_cast<char *>(&(leaf->value)), sizeof(LeafType));
-        size_--;
     }
 
-    Node *read_node(fstream &file)
+    void unindex_leaf(Leaf *leaf)
     {
-        size_t _size;
-        file.read(reinterpret_cast<char *>(&_size), sizeof(_size));
-        Node *new_node = new Node;
-        new_node->items.resize(_size);
-        file.read(reinterpret_cast<char *>(&(new_node->hasleaves)),
-                  sizeof(new_node->hasleaves));
-        for (size_t axis = 0; axis < dimensions; axis++)
+        if (key_of)
         {
-            file.read(reinterpret_cast<char *>(&(new_node->box.max_edges[axis])),
-                      sizeof(new_node->box.max_edges[axis]));
-            file.read(reinterpret_cast<char *>(&(new_node->box.min_edges[axis])),
-                      sizeof(new_node->box.min_edges[axis]));
+            for (size_t slot = 0; slot < leaf->count(); slot++)
+                key_index.erase(key_of(leaf->at(slot)));
         }
-        return new_node;
     }
 
-    Leaf *read_leaf(fstream &file)
+    size_t slot_of_key(Leaf *leaf, Handle key) const
     {
-        Leaf *new_leaf = new Leaf;
-        for (size_t axis = 0; axis < dimensions; axis++)
+        size_t slot = 0;
+        while (slot + 1 < leaf->count() && key_of(leaf->at(slot)) != key)
+            slot++;
+        return slot;
+    }
+
+    // Rebuilds the key index from the leaves after the tree was replaced.
+    void rebuild_key_index()
+    {
+        if (!key_of)
         {
-            file.read(reinterpret_cast<char *>(&(new_leaf->box.max_edges[axis])),
-                      sizeof(new_leaf->box.max_edges[axis]));
-            file.read(reinterpret_cast<char *>(&(new_leaf->box.min_edges[axis])),
-                      sizeof(new_leaf->box.min_edges[axis]));
+            return;
         }
-        file.read(reinterpret_cast<char *>(&(new_leaf->value)), sizeof(LeafType));
-        size_++;
-        return new_leaf;
+        key_index.clear();
+        key_index.reserve(size_);
+        walk_tree([](size_t, const BoundingBox &, size_t) {},
+                  [this](size_t, const LeafWithConstBox &leaf)
+                  {
+                      if (!key_index.emplace(key_of(leaf.get_value()), leaf.leaf).second)
+                      {
+                          disable_key_index();
+                          throw invalid_argument("key index: duplicate key");
+                      }
+                  });
     }
 
     /*
-    La función `find_leaf` es crucial en la búsqueda de hojas
-    dentro del árbol R-Star que están contenidas dentro de un área
-    determinada (`BoundingBox`). Aquí está su desglose:
-
-    - `void find_leaf(const BoundingBox &box,
-    vector<LeafWithConstBox> &leafs, Node *node)`:
-    Esta función toma tres argumentos:
-        - `box`: El área de búsqueda representada por
-        un cuadro delimitador.
-        - `leafs`: Un vector que almacenará las hojas
-        encontradas dentro del área.
-        - `node`: El nodo actual en el que se está buscando.
+    Predicados usados por find_leaf() y QueryCursor:
+
+    * leaf_matches(): prueba final sobre la geometría de una hoja. Con
+    hojas puntuales las tres variantes se reducen a la prueba
+    punto-en-caja (y contains solo acepta un área degenerada en el
+    mismo punto).
+    * node_may_match(): un nodo puede tener hojas que cumplen el
+    predicado. Para intersects y within basta con que el nodo toque el
+    área (intersección cerrada); para contains el nodo debe contener
+    el área, porque cada hoja está dentro de la caja de su nodo.
+    * is_covered(): la caja del nodo está dentro del área, así que
+    todas sus hojas cumplen intersects y within. Para contains no
+    existe un atajo equivalente, y para overlaps tampoco con hojas con
+    caja: una caja degenerada dentro del área no cumple.
+    */
+    static bool leaf_matches(const BoundingBox &query, const LeafGeometry &leaf_box,
+                             query_type type)
+    {
+        switch (type)
+        {
+        case query_type::within:
+            return leaf_box.within(query);
+        case query_type::contains:
+            return leaf_box.contains(query);
+        case query_type::overlaps:
+            return query.is_intersected(leaf_box);
+        default:
+            return query.intersects(leaf_box);
+        }
+    }
 
-    La función opera de la siguiente manera:
+    static bool node_may_match(const BoundingBox &query, const BoundingBox &node_box,
+                               query_type type)
+    {
+        if (type == query_type::contains)
+        {
+            return node_box.contains(query);
+        }
+        return query.touches(node_box);
+    }
 
-    - Verifica si el nodo actual contiene hojas (`node->hasleaves`).
-    Si es así, itera a través de las hojas presentes en ese nodo.
-        - Para cada hoja, se convierte el elemento del nodo a un puntero `Leaf`.
-        - Comprueba si la caja delimitadora de esa hoja (`temp_leaf->box`)
-        se intersecta con el área de búsqueda (`box`).
-        - Si hay una intersección, agrega esa hoja al vector `leafs`.
+    static bool is_covered(const BoundingBox &query, const BoundingBox &node_box,
+                           query_type type)
+    {
+        return type != query_type::contains && (point_leaves || type != query_type::overlaps) &&
+               node_box.within(query);
+    }
 
-    - Si el nodo actual no contiene hojas (`node->hasleaves` es falso),
-    significa que contiene nodos secundarios.
-        - Itera a través de los nodos secundarios presentes en el
-        nodo actual.
-        - Para cada nodo secundario, se convierte el elemento del nodo
-        a un puntero `Node`.
-        - Comprueba si la caja delimitadora de ese nodo secundario
-        (`temp_node->box`) se intersecta con el área de búsqueda (`box`).
-        - Si hay una intersección, se llama recursivamente a
-        `find_leaf()` con ese nodo secundario como nuevo nodo actual.
+    // Weighted squared distance from `point` to the inline copy of a child box
+    // (MINDIST). It stops adding axes once the sum passes `limit`.
+    static double child_distance(const ChildBox &child, const Point &point, const Weights &weights,
+                                 double limit = numeric_limits<double>::infinity())
+    {
+        double sum = 0;
+        for (size_t axis = 0; axis < dimensions && sum <= limit; axis++)
+        {
+            double value = point.coords[axis];
+            double d = value < child[2 * axis]       ? child[2 * axis] - value
+                       : value > child[2 * axis + 1] ? value - child[2 * axis + 1]
+                                                     : 0;
+            sum += weights[axis] * d * d;
+        }
+        return sum;
+    }
 
-    Este proceso continúa hasta que se recorren todos los nodos del árbol
-    y se encuentran todas las hojas que se superponen con el área de búsqueda.
-    Las hojas encontradas se almacenan en el vector `leafs`, que luego se
-    devuelve a la función que la llamó.
-    */
-    void find_leaf(const BoundingBox &box, vector<LeafWithConstBox> &leafs,
-                   Node *node)
+    // Weighted squared distance from `point` to the farthest corner of a child box (MAXDIST).
+    static double child_max_distance(const ChildBox &child, const Point &point, const Weights &weights)
     {
-        if (node->hasleaves)
+        double sum = 0;
+        for (size_t axis = 0; axis < dimensions; axis++)
         {
-            for (size_t i = 0; i < node->items.size(); i++)
-            {
-                Leaf *temp_leaf = static_cast<Leaf *>(node->items[i]);
-                if (box.is_intersected((temp_leaf->box)))
-                {
-                    leafs.push_back({temp_leaf});
-                }
-            }
+            double d = max(abs(point.coords[axis] - child[2 * axis]),
+                           abs(child[2 * axis + 1] - point.coords[axis]));
+            sum += weights[axis] * d * d;
         }
-        else
+        return sum;
+    }
+
+    // node_may_match() on the inline copy of a child box held by its parent.
+    static bool child_may_match(const ChildBox &child, const BoundingBox &query,
+                                query_type type)
+    {
+        for (size_t axis = 0; axis < dimensions; axis++)
         {
-            for (size_t i = 0; i < node->items.size(); i++)
+            double lo = child[2 * axis], hi = child[2 * axis + 1];
+            if (type == query_type::contains
+                    ? query.min_edges[axis] < lo || query.max_edges[axis] > hi
+                    : max(lo, query.min_edges[axis]) > min(hi, query.max_edges[axis]))
             {
-                Node *temp_node = static_cast<Node *>(node->items[i]);
-                if (box.is_intersected((temp_node->box)))
-                {
-                    find_leaf(box, leafs, temp_node);
-                }
+                return false;
             }
         }
+        return true;
     }
 
     /*
@@ -348,7 +2225,8 @@ private:
 
         - Si una hoja se intersecta con el cuadro delimitador,
         se intercambia con la última hoja (`swap`) y luego se
-        elimina (`delete`) esa última hoja. Posteriormente, se
+        elimina (`delete`) esa última hoja junto con todos los
+        valores agrupados en ella, descontándolos de `size_`. Posteriormente, se
         quita del vector de hojas del nodo (`pop_back`) y se
         reduce el índice `i` para volver a comprobar la nueva
         hoja en la posición actual.
@@ -380,12 +2258,15 @@ private:
           // children are tested.
             for (size_t i = 0; i < node->items.size(); i++)
             {
-                if (box.is_intersected((node->items[i]->box)))
+                if (box.is_intersected((static_cast<Leaf *>(node->items[i])->box)))
                 {
                     swap(node->items[i],
                          node->items.back());  // changing from the last one
-                    delete node->items.back(); // delete the last one
+                    size_ -= static_cast<Leaf *>(node->items.back())->count();
+                    unindex_leaf(static_cast<Leaf *>(node->items.back()));
+                    free_leaf(static_cast<Leaf *>(node->items.back())); // delete the last one
                     node->items.pop_back();
+                    mark_dirty(node);
                     i--;
                 }
             }
@@ -395,7 +2276,7 @@ private:
         {
             for (size_t i = 0; i < node->items.size(); i++)
             {
-                if (box.is_intersected((node->items[i]->box)))
+                if (box.touches((static_cast<Node *>(node->items[i])->box)))
                 {
                     delete_leafs(box,
                                  static_cast<Node *>(
@@ -404,10 +2285,7 @@ private:
                 }
             }
         }
-        for (size_t i = 0; i < node->items.size(); i++)
-        {
-            node->box.stretch(node->items[i]->box);
-        }
+        refresh_box(node);
     }
 
     /*
@@ -467,6 +2345,7 @@ private:
         { // If the children of the node are leaves, add a
           // leaf to the array
             node->items.push_back(leaf);
+            mark_dirty(node);
         }
         else
         {
@@ -475,10 +2354,13 @@ private:
             if (!new_node)
             { // choose_leaf_and_insert will return the location, it
               // will be inserted into the children's array
+                sync_child_boxes(node);
                 return nullptr;
             }
             node->items.push_back(new_node);
+            mark_dirty(node);
         }
+        sync_child_boxes(node);
         if (node->items.size() > max_child_items)
         {
             return overflow_treatment(
@@ -537,6 +2419,7 @@ private:
             parent_node->items.push_back(
                 node); // The location is set at a predetermined depth so that the
                        // tree remains perfectly balanced.
+            mark_dirty(parent_node);
         }
         else
         {
@@ -544,9 +2427,14 @@ private:
                 choose_node_and_insert(node, choose_subtree(parent_node, node->box),
                                        required_deep, deep + 1);
             if (!new_node)
+            {
+                sync_child_boxes(parent_node);
                 return nullptr;
+            }
             parent_node->items.push_back(new_node);
+            mark_dirty(parent_node);
         }
+        sync_child_boxes(parent_node);
         if (parent_node->items.size() > max_child_items)
         {
             return overflow_treatment(parent_node, deep);
@@ -608,7 +2496,7 @@ private:
      elegir el subárbol de inserción.
 
     - La variable `min_area_node` se inicializa como `nullptr` y
-    `min_area` con el valor máximo de `int`. Luego, se compara el
+    `min_area` con el valor máximo de `cost_type`. Luego, se compara el
     área de cada nodo en `area_preferable_nodes` y se actualiza
     `min_area_node` si encuentra un nodo con un área menor.
 
@@ -620,19 +2508,20 @@ private:
     función del solapamiento y el área para mantener la estructura
     del árbol de manera equilibrada y eficiente.
     */
-    Node *choose_subtree(Node *node, const BoundingBox &box)
+    template <typename Geometry>
+    Node *choose_subtree(Node *node, const Geometry &box)
     {
-        vector<TreePart *> overlap_preferable_nodes;
+        vector<Node *> overlap_preferable_nodes;
         if (static_cast<Node *>(node->items[0])
                 ->hasleaves)
         { // If the child nodes are terminal nodes, the node
           // with the smallest overlap is searched for
-            int min_overlap_enlargement(numeric_limits<int>::max());
-            int overlap_enlargement(0);
+            cost_type min_overlap_enlargement(numeric_limits<cost_type>::max());
+            cost_type overlap_enlargement(0);
             for (size_t i = 0; i < node->items.size(); i++)
             {
-                TreePart *temp = (node->items[i]);
-                overlap_enlargement = box.area() - box.overlap(temp->box);
+                Node *temp = static_cast<Node *>(node->items[i]);
+                overlap_enlargement = geometry_area(box) - geometry_overlap(box, temp->box);
                 if (overlap_enlargement < min_overlap_enlargement)
                 {
                     min_overlap_enlargement = overlap_enlargement;
@@ -650,25 +2539,27 @@ private:
             if (overlap_preferable_nodes.size() ==
                 1)
             { // If there's only one node, it's a special node.
-                return static_cast<Node *>(overlap_preferable_nodes.front());
+                return overlap_preferable_nodes.front();
             } // If not, then a space with the smallest possible increase in area is
               // searched for
         }
         else
         { // If the child nodes are not terminal, keep them in the array
             overlap_preferable_nodes.reserve(node->items.size());
-            copy(node->items.begin(), node->items.end(),
-                 back_inserter(overlap_preferable_nodes));
+            for (TreePart *item : node->items)
+            {
+                overlap_preferable_nodes.push_back(static_cast<Node *>(item));
+            }
         }
-        int min_area_enlargement =
-            numeric_limits<int>::max(); // for both terminal and nonterminal
-        int area_enlargement(0);        // subsequent steps are the same
-        vector<TreePart *> area_preferable_nodes;
+        cost_type min_area_enlargement =
+            numeric_limits<cost_type>::max(); // for both terminal and nonterminal
+        cost_type area_enlargement(0);        // subsequent steps are the same
+        vector<Node *> area_preferable_nodes;
         for (size_t i = 0; i < overlap_preferable_nodes.size(); i++)
         {
-            BoundingBox temp(box);
-            temp.stretch(overlap_preferable_nodes[i]->box);
-            area_enlargement = temp.area() - box.area();
+            BoundingBox temp(overlap_preferable_nodes[i]->box);
+            temp.stretch(box);
+            area_enlargement = temp.area() - geometry_area(box);
             if (min_area_enlargement > area_enlargement)
             {
                 min_area_enlargement = area_enlargement;
@@ -687,20 +2578,37 @@ private:
             1)
         { // If there is only one minimum-increase-area node, it will be
           // returned
-            return static_cast<Node *>(area_preferable_nodes.front());
+            return area_preferable_nodes.front();
         }
-        TreePart *min_area_node{nullptr}; // Looking for a node among the remaining
+        Node *min_area_node{nullptr}; // Looking for a node among the remaining
                                           // ones with the smallest possible area
-        int min_area(numeric_limits<int>::max());
+        cost_type min_area(numeric_limits<cost_type>::max());
         for (size_t i = 0; i < area_preferable_nodes.size(); i++)
         {
-            if (min_area > area_preferable_nodes[i]->box.area())
+            cost_type area = area_preferable_nodes[i]->box.area();
+            if (min_area > area)
             {
+                min_area = area;
                 min_area_node = area_preferable_nodes[i];
             }
         }
-        return static_cast<Node *>(min_area_node);
+        return min_area_node;
+    }
+
+    /*
+    Área y solapamiento de la geometría que se inserta, usados por
+    choose_subtree(). Un punto no tiene área ni solapamiento, así que
+    para hojas puntuales la elección depende solo del aumento de área
+    del nodo.
+    */
+    static cost_type geometry_area(const BoundingBox &box) { return box.area(); }
+    static cost_type geometry_area(const Point &) { return 0; }
+
+    static cost_type geometry_overlap(const BoundingBox &box, const BoundingBox &node_box)
+    {
+        return box.overlap(node_box);
     }
+    static cost_type geometry_overlap(const Point &, const BoundingBox &) { return 0; }
 
     /*
     Parámetros:
@@ -716,9 +2624,11 @@ private:
     Si estas condiciones se cumplen, se activa el método de reinserción
     forzada (forced_reinsert) y se devuelve nullptr. Esta es una técnica
     para equilibrar el árbol, permitiendo una única reinserción por
-    profundidad y evitando que la raíz del árbol sea reinsertada.
+    profundidad y evitando que la raíz del árbol sea reinsertada. Si
+    reinsert_fraction no alcanza para sacar ni un hijo, se divide
+    directamente.
 
-    * Node *splitted_node = split(node);: Se invoca la función split
+    * Node *splitted_node = split(node, params);: Se invoca la función split
     para dividir el nodo en dos. Esta operación elimina los elementos
     innecesarios del nodo y devuelve un puntero al nuevo nodo creado
     tras la división.
@@ -744,27 +2654,25 @@ private:
     Node *overflow_treatment(Node *node, int deep)
     {
         if (used_deeps.count(deep) == 0 &&
-            tree_root != node)
+            tree_root != node && reinsert_count(node) > 0)
         { // The reinsertion method can be used only once
           // per depth and not for the root.
             forced_reinsert(node, deep);
             return nullptr;
         }
+        SplitParameters params = choose_split_axis_and_index(node);
         Node *splitted_node =
-            split(node); // deletes unnecessary children from the node and returns
-                         // the location with them
+            split(node, params); // deletes unnecessary children from the node and returns
+                                 // the location with them
         if (node == tree_root)
         { // If node is the root of a tree, it grows one
           // level upward
             Node *temp = new Node;
             temp->hasleaves = false;
-            temp->items.reserve(min_child_items);
             temp->items.push_back(tree_root);
             temp->items.push_back(splitted_node);
             tree_root = temp;
-            tree_root->box.reset();
-            tree_root->box.stretch(temp->items[0]->box);
-            tree_root->box.stretch(temp->items[1]->box);
+            refresh_box(tree_root);
 
             return nullptr;
         }
@@ -778,10 +2686,9 @@ private:
     que ha excedido el límite de capacidad (`max_child_items`).
     Aquí está el análisis línea por línea:
 
-    - `SplitParameters params = choose_split_axis_and_index(node);`:
-    Esta línea determina el eje de división y el índice en el
-    que se dividirá el nodo. `choose_split_axis_and_index`
-    devuelve los parámetros más óptimos para dividir el nodo.
+    - `SplitParameters params`: el eje de división y el índice en el
+    que se dividirá el nodo, ya elegidos por
+    `choose_split_axis_and_index` en overflow_treatment().
 
     - `sort(node->items.begin(), node->items.end(), [&params](auto lhs, auto rhs) {...});`:
     Los elementos del nodo se ordenan según el eje y el
@@ -792,10 +2699,6 @@ private:
     - `Node *new_Node = new Node;`: Se crea un nuevo nodo para
     almacenar los elementos que se separarán del nodo original.
 
-    - `new_Node->items.reserve(max_child_items + 1
-    - min_child_items - params.index);`:
-    Se reserva espacio en el nuevo nodo para los elementos que serán movidos a este nodo.
-
     - `copy(node->items.begin() + min_child_items +
     params.index, node->items.end(), back_inserter(new_Node->items));`:
     Los elementos seleccionados para la división se copian al
@@ -806,44 +2709,172 @@ private:
      y del nuevo nodo (`new_Node->box`) para reflejar los
      cambios de elementos en ambos nodos.
 
-    - Finalmente, se devuelve el nuevo nodo creado, que contiene
-    los elementos que se han separado del nodo original, y el
-    nodo original ha sido modificado para reflejar
-    la eliminación de estos elementos.
+    - Finalmente, se devuelve el nuevo nodo creado, que contiene
+    los elementos que se han separado del nodo original, y el
+    nodo original ha sido modificado para reflejar
+    la eliminación de estos elementos.
+
+    Esta función es esencial para mantener el equilibrio y la
+    capacidad adecuada de los nodos en el árbol R-Star al
+    dividir un nodo cuando excede su capacidad máxima permitida.
+    */
+    Node *split(Node *node, const SplitParameters &params)
+    {
+        sort_for_split(node, params);
+        Node *new_Node = new Node;
+        new_Node->hasleaves = node->hasleaves;
+        copy(node->items.begin() + min_child_items + params.index,
+             node->items.end(), back_inserter(new_Node->items));
+        node->items.erase(node->items.begin() + min_child_items + params.index,
+                          node->items.end());
+        mark_dirty(node);
+        refresh_box(node);
+        refresh_box(new_Node);
+        return new_Node;
+    }
+
+    void sort_for_split(Node *node, const SplitParameters &params)
+    {
+        sort_children(node,
+                      [&params](auto lhs, auto rhs)
+                      {
+                          return lhs->box.value_of_axis(params.axis, params.type) <
+                                 rhs->box.value_of_axis(params.axis, params.type);
+                      });
+    }
+
+    /*
+    Los hijos de un nodo son todos hojas (hasleaves) o todos nodos, y
+    la geometría de una hoja puede ser un punto. for_each_child() y
+    sort_children() convierten cada hijo a su tipo real antes de llamar
+    a la función dada, así la división, la reinserción y el ajuste de
+    cajas se escriben una sola vez para ambos casos.
+    */
+    template <typename F>
+    static void for_each_child(Node *node, size_t from, size_t to, F f)
+    {
+        for (size_t i = from; i < to; i++)
+        {
+            if (node->hasleaves)
+                f(static_cast<Leaf *>(node->items[i]));
+            else
+                f(static_cast<Node *>(node->items[i]));
+        }
+    }
+
+    template <typename F>
+    static void for_each_child(Node *node, F f)
+    {
+        for_each_child(node, 0, node->items.size(), f);
+    }
+
+    template <typename Compare>
+    static void sort_children(Node *node, Compare compare)
+    {
+        if (node->hasleaves)
+            sort(node->items.begin(), node->items.end(),
+                 [&compare](TreePart *lhs, TreePart *rhs)
+                 { return compare(static_cast<Leaf *>(lhs), static_cast<Leaf *>(rhs)); });
+        else
+            sort(node->items.begin(), node->items.end(),
+                 [&compare](TreePart *lhs, TreePart *rhs)
+                 { return compare(static_cast<Node *>(lhs), static_cast<Node *>(rhs)); });
+    }
 
-    Esta función es esencial para mantener el equilibrio y la
-    capacidad adecuada de los nodos en el árbol R-Star al
-    dividir un nodo cuando excede su capacidad máxima permitida.
+    /*
+    str_sort() ordena [first, last) para el empaquetado STR: por el
+    centro en el eje `axis`, luego corta el tramo en franjas que
+    contienen un número entero de grupos de `chunk` elementos y ordena
+    cada franja por el eje siguiente. Así cada grupo consecutivo de
+    `chunk` elementos queda compacto en todos los ejes.
     */
-    Node *split(Node *node)
-    {
-        SplitParameters params = choose_split_axis_and_index(
-            node); // The most optimal index and axis are selected
-        sort(node->items.begin(), node->items.end(),
-             [&params](auto lhs, auto rhs)
-             {
-                 return lhs->box.value_of_axis(params.axis, params.type) <
-                        rhs->box.value_of_axis(params.axis, params.type);
-             });
-        Node *new_Node = new Node;
-        new_Node->items.reserve(max_child_items + 1 - min_child_items -
-                                params.index);
-        new_Node->hasleaves = node->hasleaves;
-        copy(node->items.begin() + min_child_items + params.index,
-             node->items.end(), back_inserter(new_Node->items));
-        node->items.erase(node->items.begin() + min_child_items + params.index,
-                          node->items.end());
-        new_Node->box.reset();
-        node->box.reset();
-        for (auto &w : node->items)
+    template <typename Iter>
+    static void str_sort(Iter first, Iter last, size_t axis, size_t chunk, bool leaves,
+                         unsigned threads)
+    {
+        size_t n = last - first;
+        parallel_sort(first, last,
+                      [axis, leaves](TreePart *lhs, TreePart *rhs)
+                      { return center_of(lhs, leaves, axis) < center_of(rhs, leaves, axis); },
+                      threads);
+        if (axis + 1 == dimensions || n <= chunk)
+        {
+            return;
+        }
+        size_t tiles = (n + chunk - 1) / chunk;
+        size_t slabs = size_t(ceil(pow(double(tiles), 1.0 / (dimensions - axis))));
+        size_t slab_size = chunk * ((tiles + slabs - 1) / slabs);
+        parallel_for((n + slab_size - 1) / slab_size, threads, [&](size_t slab)
+                     { str_sort(first + slab * slab_size, first + min(n, (slab + 1) * slab_size),
+                                axis + 1, chunk, leaves, 1); });
+    }
+
+    static double center_of(TreePart *part, bool leaf, size_t axis)
+    {
+        if (leaf)
         {
-            node->box.stretch(w->box);
+            const LeafGeometry &box = static_cast<Leaf *>(part)->box;
+            return (box.value_of_axis(axis, axis_type::lower) +
+                    box.value_of_axis(axis, axis_type::upper)) / 2;
         }
-        for (auto &w : new_Node->items)
+        const BoundingBox &box = static_cast<Node *>(part)->box;
+        return (box.min_edges[axis] + box.max_edges[axis]) / 2;
+    }
+
+    // Packs one level: STR order, then ceil(n / max_child_items) parents
+    // with the children split as evenly as possible.
+    static vector<TreePart *> pack(vector<TreePart *> &parts, bool leaves)
+    {
+        str_sort(parts.begin(), parts.end(), 0, max_child_items, leaves, 1);
+        size_t n = parts.size();
+        size_t count = (n + max_child_items - 1) / max_child_items;
+        vector<TreePart *> parents(count);
+        for (size_t k = 0; k < count; k++)
         {
-            new_Node->box.stretch(w->box);
+            Node *node = new Node;
+            node->hasleaves = leaves;
+            for (size_t i = n * k / count; i < n * (k + 1) / count; i++)
+            {
+                node->items.push_back(parts[i]);
+            }
+            refresh_box(node);
+            parents[k] = node;
         }
-        return new_Node;
+        return parents;
+    }
+
+    // Records that the children of a node already in the page file changed.
+    void mark_dirty(Node *node)
+    {
+        if (node->page && !node->dirty)
+        {
+            node->dirty = true;
+            dirty_nodes.insert(node);
+        }
+    }
+
+    // Recomputes the node box and the inline child box copies from its children.
+    static void refresh_box(Node *node)
+    {
+        node->box.reset();
+        for_each_child(node, [node](auto *child)
+                       { node->box.stretch(child->box); });
+        sync_child_boxes(node);
+    }
+
+    static void sync_child_boxes(Node *node)
+    {
+        node->child_boxes.resize(node->items.size());
+        ChildBox *copy = node->child_boxes.begin();
+        for_each_child(node, [node, &copy](auto *child)
+                       {
+                           child->parent = node;
+                           for (size_t axis = 0; axis < dimensions; axis++)
+                           {
+                               (*copy)[2 * axis] = child->box.value_of_axis(axis, axis_type::lower);
+                               (*copy)[2 * axis + 1] = child->box.value_of_axis(axis, axis_type::upper);
+                           }
+                           copy++; });
     }
 
     /*
@@ -851,12 +2882,9 @@ private:
     algunos de los hijos de un nodo dado dentro del árbol.
     Aquí está el análisis línea por línea:
 
-    - `double p = 0.3;`: Esta línea define el porcentaje de
-    hijos que se eliminarán del nodo actual para ser reinsertados en el árbol.
-
-    - `int number = node->items.size() * p;`: Se calcula el
-    número de elementos que se eliminarán del nodo para su
-    reinyección, basado en el porcentaje definido.
+    - `reinsert_count(node)`: el número de elementos que se
+    eliminarán del nodo para su reinyección, la fracción
+    reinsert_fraction de sus hijos (30% por defecto).
 
     - `sort(node->items.begin(), node->items.end(),
     [&node](auto lhs, auto rhs) {...});`:
@@ -892,30 +2920,30 @@ private:
     del árbol, ya que permite redistribuir algunos elementos en el
     árbol cuando un nodo alcanza una capacidad máxima y necesita reducir su contenido.
     */
+    size_t reinsert_count(const Node *node) const
+    {
+        return size_t(node->items.size() * min(max(reinsert_fraction, 0.0), 0.5));
+    }
+
     void forced_reinsert(Node *node,
                          int deep)
-    {                   // Some of the children of the given tree
-                        // are reinserted into the tree
-        double p = 0.3; // Percentage of children that will be deleted from the
-                        // node location
-        int number = node->items.size() * p;
-        sort(node->items.begin(), node->items.end(),
-             [&node](auto lhs, auto rhs)
-             {
-                 return lhs->box.dist_between_centers(node->box) <
-                        rhs->box.dist_between_centers(node->box);
-             });
+    { // Some of the children of the given tree
+      // are reinserted into the tree
+        size_t number = reinsert_count(node);
+        sort_children(node,
+                      [&node](auto lhs, auto rhs)
+                      {
+                          return lhs->box.dist_between_centers(node->box) <
+                                 rhs->box.dist_between_centers(node->box);
+                      });
         vector<TreePart *> forced_reinserted_nodes;
         forced_reinserted_nodes.reserve(number);
         copy(node->items.rbegin(), node->items.rbegin() + number,
              back_inserter(forced_reinserted_nodes));
         node->items.erase(node->items.end() - number, node->items.end());
-        node->box.reset();
+        mark_dirty(node);
         used_deeps.insert(deep);
-        for (TreePart *w : node->items)
-        {
-            node->box.stretch(w->box);
-        }
+        refresh_box(node);
         if (node->hasleaves) // If the children of the top are leaves, they are
                              // inserted again using the method
                              // choose_leaf_and_insert.
@@ -938,11 +2966,11 @@ private:
     y el índice óptimos para dividir un nodo en dos partes.
     Aquí tienes un análisis detallado:
 
-    - `int min_margin(numeric_limits<int>::max());`:
+    - `cost_type min_margin(numeric_limits<cost_type>::max());`:
     Inicializa una variable para rastrear el margen mínimo
     encontrado durante el proceso de división.
 
-    - `int distribution_count(max_child_items - 2 * min_child_items + 2);`:
+    - `int distribution_count(node->items.size() - 2 * min_child_items + 1);`:
     Calcula el número total de distribuciones posibles para
      los elementos en los nodos hijos resultantes de la división.
 
@@ -981,8 +3009,9 @@ private:
     */
     SplitParameters choose_split_axis_and_index(Node *node)
     {
-        int min_margin(numeric_limits<int>::max());
-        int distribution_count(max_child_items - 2 * min_child_items + 2);
+        cost_type min_margin(numeric_limits<cost_type>::max());
+        int count = node->items.size(); // max_child_items + 1
+        int distribution_count(count - 2 * min_child_items + 1);
         SplitParameters params;
         BoundingBox b1, b2;
         for (int axis(0); axis < dimensions;
@@ -999,26 +3028,21 @@ private:
                 {
                     type = axis_type::upper;
                 }
-                sort(node->items.begin(), node->items.end(),
-                     [&axis, &type](auto &lhs, auto &rhs)
-                     {
-                         return lhs->box.value_of_axis(axis, type) <
-                                rhs->box.value_of_axis(axis, type);
-                     });
+                sort_children(node,
+                              [&axis, &type](auto lhs, auto rhs)
+                              {
+                                  return lhs->box.value_of_axis(axis, type) <
+                                         rhs->box.value_of_axis(axis, type);
+                              });
                 for (int k(0); k < distribution_count; k++)
                 {
-                    int area(0);
                     b1.reset();
                     b2.reset();
-                    for (int i = 0; i < min_child_items + k; i++)
-                    {
-                        b1.stretch(node->items[i]->box);
-                    }
-                    for (int i = min_child_items + k; i < max_child_items + 1; i++)
-                    {
-                        b2.stretch(node->items[i]->box);
-                    }
-                    int margin = b1.margin() + b2.margin();
+                    for_each_child(node, 0, min_child_items + k, [&b1](auto *child)
+                                   { b1.stretch(child->box); });
+                    for_each_child(node, min_child_items + k, count, [&b2](auto *child)
+                                   { b2.stretch(child->box); });
+                    cost_type margin = b1.margin() + b2.margin();
                     if (margin < min_margin)
                     {
                         min_margin = margin;
@@ -1065,7 +3089,7 @@ private:
         {
             for (size_t i = 0; i < node->items.size(); i++)
             {
-                delete node->items[i];
+                free_leaf(static_cast<Leaf *>(node->items[i]));
             }
         }
         else
@@ -1075,10 +3099,348 @@ private:
                 delete_tree(static_cast<Node *>(node->items[i]));
             }
         }
-        delete node;
+        free_node(node);
+    }
+
+    /*
+    Las partes copiadas por relayout() viven en node_arena y
+    leaf_arena y no se liberan una por una: free_node() y free_leaf()
+    solo hacen delete de las partes creadas con new después de la
+    última reorganización. Una hoja de la arena que se elimina deja un
+    hueco hasta el siguiente relayout() o hasta destruir el árbol.
+    */
+    template <typename Part>
+    static bool in_arena(const Part *part, const vector<Part> &arena)
+    {
+        less<const Part *> before;
+        return !arena.empty() && !before(part, arena.data()) &&
+               before(part, arena.data() + arena.size());
+    }
+
+    void free_node(Node *node)
+    {
+        if (node->dirty)
+        {
+            dirty_nodes.erase(node);
+        }
+        if (node->page)
+        {
+            auto written = page_bytes.find(node->page);
+            if (written != page_bytes.end())
+            {
+                live_page_bytes -= written->second;
+                page_bytes.erase(written);
+            }
+        }
+        if (!in_arena(node, node_arena))
+        {
+            delete node;
+        }
+    }
+
+    void free_leaf(Leaf *leaf)
+    {
+        if (in_arena(leaf, leaf_arena))
+        {
+            vector<LeafType>().swap(leaf->bucket);
+        }
+        else
+        {
+            delete leaf;
+        }
+    }
+
+    void count_parts(const Node *node, size_t &nodes, size_t &leaves) const
+    {
+        nodes++;
+        if (node->hasleaves)
+        {
+            leaves += node->items.size();
+            return;
+        }
+        for (TreePart *item : node->items)
+        {
+            count_parts(static_cast<const Node *>(item), nodes, leaves);
+        }
+    }
+
+    // Preorder copy: every node is followed by its whole subtree, and
+    // the leaves of one node are adjacent.
+    Node *copy_subtree(Node *node, vector<Node> &nodes, vector<Leaf> &leaves)
+    {
+        nodes.emplace_back();
+        Node *copy = &nodes.back();
+        copy->box = node->box;
+        copy->hasleaves = node->hasleaves;
+        copy->child_boxes = node->child_boxes;
+        swap(copy->page, node->page); // the copy keeps the node's page in the page file
+        if (node->dirty)
+        {
+            dirty_nodes.erase(node);
+            node->dirty = false;
+            mark_dirty(copy);
+        }
+        for (TreePart *item : node->items)
+        {
+            if (node->hasleaves)
+            {
+                leaves.push_back(move(*static_cast<Leaf *>(item)));
+                copy->items.push_back(&leaves.back());
+            }
+            else
+            {
+                copy->items.push_back(copy_subtree(static_cast<Node *>(item), nodes, leaves));
+            }
+            copy->items.back()->parent = copy;
+        }
+        return copy;
     }
 
 public:
+    /*
+    relayout() copia el árbol a dos bloques contiguos de memoria, uno
+    para los nodos y otro para las hojas, en orden de recorrido en
+    profundidad (preorden), y reescribe los punteros a los hijos.
+    Después de muchas inserciones, reinserciones y divisiones los
+    nodos quedan repartidos por el heap en orden de creación; tras la
+    reorganización una búsqueda recorre la memoria hacia adelante y el
+    prefetch del procesador puede anticipar los accesos.
+
+    Se usa después de una carga completa, antes de abrir el índice a
+    consultas, y solo vale la pena cuando el árbol no cabe en la caché:
+    con los 499 pacientes del archivo covid las búsquedas tardan lo
+    mismo antes y después, así que los programas no la llaman por
+    defecto. El árbol sigue aceptando inserciones y eliminaciones:
+    los nodos nuevos se crean con new como siempre. Los cursores
+    abiertos y sus tokens quedan invalidados, igual que con cualquier
+    modificación.
+    */
+    void relayout()
+    {
+        if (!tree_root)
+        {
+            return;
+        }
+        size_t nodes = 0, leaves = 0;
+        count_parts(tree_root, nodes, leaves);
+        vector<Node> new_nodes;
+        vector<Leaf> new_leaves;
+        new_nodes.reserve(nodes);
+        new_leaves.reserve(leaves);
+        Node *new_root = copy_subtree(tree_root, new_nodes, new_leaves);
+        delete_tree(tree_root);
+        tree_root = new_root;
+        node_arena.swap(new_nodes);
+        leaf_arena.swap(new_leaves);
+        version_++;
+        rebuild_key_index();
+    }
+
+    /*
+    save() y load() escriben y leen una instantánea binaria del árbol
+    completo: un encabezado (formato, dimensiones, tamaño de LeafType,
+    cantidad de valores) y luego los nodos en preorden con
+    write_node(), cada uno seguido de sus hijos; las hojas con
+    write_leaf(). Los valores se copian byte a byte, así que LeafType
+    debe ser trivialmente copiable.
+
+    load() reemplaza el contenido actual del árbol y recalcula las
+    cajas de los nodos y sus copias en child_boxes con refresh_box().
+    Si el archivo está truncado o es de otro árbol se lanza
+    invalid_argument.
+    */
+    void save(ostream &out)
+    {
+        static_assert(is_trivially_copyable<LeafType>::value,
+                      "save: LeafType must be trivially copyable");
+        uint64_t header[5] = {snapshot_magic, dimensions, sizeof(LeafType), point_leaves, size_};
+        out.write(reinterpret_cast<const char *>(header), sizeof(header));
+        bool has_root = tree_root != nullptr;
+        out.write(reinterpret_cast<const char *>(&has_root), sizeof(has_root));
+        if (has_root)
+        {
+            write_subtree(tree_root, out);
+        }
+        if (!out)
+        {
+            throw invalid_argument("save: write failed");
+        }
+    }
+
+    void save(const string &path)
+    {
+        ofstream file(path, ios::binary | ios::trunc);
+        save(file);
+    }
+
+    void load(istream &in)
+    {
+        static_assert(is_trivially_copyable<LeafType>::value,
+                      "load: LeafType must be trivially copyable");
+        uint64_t header[5];
+        bool has_root = false;
+        in.read(reinterpret_cast<char *>(header), sizeof(header));
+        in.read(reinterpret_cast<char *>(&has_root), sizeof(has_root));
+        if (!in || header[0] != snapshot_magic || header[1] != dimensions ||
+            header[2] != sizeof(LeafType) || header[3] != point_leaves)
+        {
+            throw invalid_argument("load: not a snapshot of this tree type");
+        }
+        if (tree_root)
+        {
+            delete_tree(tree_root);
+            tree_root = nullptr;
+        }
+        node_arena.clear();
+        leaf_arena.clear();
+        key_index.clear();
+        size_ = 0;
+        version_++;
+        forget_pages();
+        if (has_root)
+        {
+            try
+            {
+                tree_root = read_subtree(in);
+            }
+            catch (...)
+            {
+                size_ = 0;
+                throw;
+            }
+        }
+        if (size_ != header[4])
+        {
+            throw invalid_argument("load: truncated or malformed snapshot");
+        }
+        rebuild_key_index();
+    }
+
+    void load(const string &path)
+    {
+        ifstream file(path, ios::binary);
+        if (!file)
+        {
+            throw invalid_argument("load: cannot open " + path);
+        }
+        load(file);
+    }
+
+    /*
+    checkpoint_pages() guarda el árbol en un archivo de páginas
+    (PageFile, ver pagefile.h) escribiendo solo lo que cambió desde el
+    checkpoint anterior. Cada nodo es una página: su encabezado
+    (write_node()), y después sus hojas (write_leaf()) o los números de
+    página de sus hijos. Los nodos cuyos hijos cambiaron se marcan con
+    mark_dirty() en choose_leaf_and_insert, choose_node_and_insert,
+    split, overflow_treatment, forced_reinsert, delete_leafs y al
+    agregar un duplicado a un bucket; los nodos nuevos se reconocen
+    porque todavía no tienen página. Un nodo cuya caja solo se agrandó
+    no se reescribe: las cajas se recalculan al leer.
+
+    Así un checkpoint escribe un número de páginas proporcional a los
+    cambios y no al tamaño del árbol. El archivo se reescribe completo
+    (en un temporal que luego se renombra) la primera vez, si `path` no
+    es el archivo del checkpoint anterior, o cuando las versiones
+    viejas de las páginas ya ocupan más que las vivas. `tag` se guarda
+    con el checkpoint y load_pages() la devuelve. El resultado es la
+    cantidad de páginas escritas.
+
+    load_pages() reemplaza el contenido del árbol por el último
+    checkpoint confirmado del archivo.
+    */
+    size_t checkpoint_pages(const string &path, uint64_t tag = 0)
+    {
+        static_assert(is_trivially_copyable<LeafType>::value,
+                      "checkpoint_pages: LeafType must be trivially copyable");
+        unique_ptr<PageFile> file;
+        bool full = path != pages_path || !filesystem::exists(path);
+        if (!full)
+        {
+            file.reset(new PageFile(path, false));
+            full = file->size() > 2 * live_page_bytes + 4096;
+        }
+        string target = full ? path + ".tmp" : path;
+        if (full)
+        {
+            file.reset(new PageFile(target, true));
+            forget_pages();
+            if (tree_root)
+            {
+                forget_subtree_pages(tree_root);
+            }
+        }
+        size_t written = 0;
+        if (tree_root && tree_root->page == 0)
+        {
+            written += write_page(tree_root, *file);
+        }
+        for (Node *node : dirty_nodes)
+        {
+            if (node->dirty)
+            {
+                written += write_page(node, *file);
+            }
+        }
+        dirty_nodes.clear();
+        PageTable state;
+        state.layout = page_layout();
+        state.root = tree_root ? tree_root->page : 0;
+        state.values = size_;
+        state.next_page = next_page;
+        state.tag = tag;
+        file->commit(state);
+        if (full)
+        {
+            file.reset();
+            filesystem::rename(target, path);
+            pages_path = path;
+        }
+        return written;
+    }
+
+    uint64_t load_pages(const string &path)
+    {
+        PageFile file(path, false);
+        PageTable state = file.read_table();
+        if (file.empty() || state.layout != page_layout())
+        {
+            throw invalid_argument("load_pages: not a checkpoint of this tree type");
+        }
+        if (tree_root)
+        {
+            delete_tree(tree_root);
+            tree_root = nullptr;
+        }
+        node_arena.clear();
+        leaf_arena.clear();
+        key_index.clear();
+        size_ = 0;
+        version_++;
+        forget_pages();
+        if (state.root)
+        {
+            try
+            {
+                tree_root = read_page_subtree(state.root, state, file);
+            }
+            catch (...)
+            {
+                size_ = 0;
+                forget_pages();
+                throw;
+            }
+        }
+        if (size_ != state.values)
+        {
+            throw invalid_argument("load_pages: truncated or malformed checkpoint");
+        }
+        next_page = state.next_page;
+        pages_path = path;
+        rebuild_key_index();
+        return state.tag;
+    }
+
     Node *get_root()
     {
         return tree_root;
@@ -1090,28 +3452,205 @@ public:
             for (size_t i = 0; i < node->items.size(); i++)
             {
                 Leaf *temp_leaf = static_cast<Leaf *>(node->items[i]);
-                cout << string(4 * depth, ' ') << "Leaf: Value = " << temp_leaf->value << ", Box = [";
-                for (size_t j = 0; j < dimensions; j++)
+                cout << string(4 * depth, ' ') << "Leaf: Value = " << temp_leaf->value;
+                if (!temp_leaf->bucket.empty())
                 {
-                    cout << "(" << temp_leaf->box.min_edges[j] << ", " << temp_leaf->box.max_edges[j] << ") ";
+                    cout << " (+" << temp_leaf->bucket.size() << " duplicates)";
                 }
-                cout << "]" << endl;
+                cout << ", Box = [";
+                print_geometry(temp_leaf->box);
+                cout << "]\n";
             }
         }
         else
         {
-            cout << string(4 * depth, ' ') << "Node:" << endl;
+            cout << string(4 * depth, ' ') << "Node:\n";
             for (size_t i = 0; i < node->items.size(); i++)
             {
                 Node *temp_node = static_cast<Node *>(node->items[i]);
                 cout << string(4 * depth, ' ') << "Branch: Box = [";
-                for (size_t j = 0; j < dimensions; j++)
+                print_geometry(temp_node->box);
+                cout << "]\n";
+                print_tree(temp_node, depth + 1);
+            }
+        }
+    }
+
+    /*
+    walk_tree() recorre todo el árbol en profundidad, en el orden de
+    print_tree(): llama a on_node(profundidad, caja, hijos) para cada
+    nodo y a on_leaf(profundidad, hoja) para cada valor, con la
+    profundidad del nodo que lo contiene (los valores de un bucket
+    salen uno por uno con la misma geometría). Usa una pila propia en
+    lugar de recursión.
+    */
+    template <typename NodeVisitor, typename LeafVisitor>
+    void walk_tree(NodeVisitor on_node, LeafVisitor on_leaf)
+    {
+        vector<pair<Node *, size_t>> stack;
+        if (tree_root)
+        {
+            stack.push_back({tree_root, 0});
+        }
+        while (!stack.empty())
+        {
+            auto [node, depth] = stack.back();
+            stack.pop_back();
+            on_node(depth, node->box, node->items.size());
+            if (node->hasleaves)
+            {
+                for (size_t i = 0; i < node->items.size(); i++)
                 {
-                    cout << "(" << temp_node->box.min_edges[j] << ", " << temp_node->box.max_edges[j] << ") ";
+                    Leaf *leaf = static_cast<Leaf *>(node->items[i]);
+                    for (size_t slot = 0; slot < leaf->count(); slot++)
+                    {
+                        on_leaf(depth, LeafWithConstBox(leaf, slot));
+                    }
                 }
-                cout << "]" << endl;
-                print_tree(temp_node, depth + 1);
+                continue;
+            }
+            for (size_t i = node->items.size(); i-- > 0;)
+            {
+                stack.push_back({static_cast<Node *>(node->items[i]), depth + 1});
+            }
+        }
+    }
+
+    static void print_geometry(const BoundingBox &box)
+    {
+        for (size_t j = 0; j < dimensions; j++)
+        {
+            cout << "(" << box.min_edges[j] << ", " << box.max_edges[j] << ") ";
+        }
+    }
+
+    static void print_geometry(const Point &point)
+    {
+        for (size_t j = 0; j < dimensions; j++)
+        {
+            cout << "(" << point.coords[j] << ") ";
+        }
+    }
+
+    /*
+    TreeStats resume la calidad estructural del árbol:
+
+    - height: número de niveles de nodos (la raíz cuenta como 1).
+    - nodes / leaf_nodes: nodos totales y nodos cuyos hijos son hojas.
+    - leaves: número de hojas almacenadas.
+    - values: número de valores; mayor que leaves cuando hay hojas
+    agrupadas por caja repetida.
+    - total_overlap: suma, en todos los nodos, del solapamiento entre
+    cada par de cajas hijas. Un buen R*-tree lo mantiene bajo.
+    - coverage: suma de las áreas de las cajas de todos los nodos.
+    - leaf_bytes: memoria ocupada por las hojas (estructura, geometría
+    y valores agrupados), para comparar hojas con caja y puntuales.
+    - child_box_bytes: memoria de las geometrías completas de los hijos
+    de todos los nodos.
+    - node_bytes: tamaño de un nodo (sizeof(Node), con los hijos en
+    línea); crece con dimensions y max_child_items.
+
+    Las medidas se calculan siempre en double, sin importar cost_type,
+    para poder comparar árboles construidos con distintas aritméticas.
+    */
+    struct TreeStats
+    {
+        size_t height{0};
+        size_t nodes{0};
+        size_t leaf_nodes{0};
+        size_t leaves{0};
+        size_t values{0};
+        double total_overlap{0};
+        double coverage{0};
+        size_t leaf_bytes{0};
+        size_t child_box_bytes{0};
+        size_t node_bytes{sizeof(Node)};
+    };
+
+    TreeStats stats() const
+    {
+        TreeStats result;
+        if (tree_root)
+        {
+            collect_stats(tree_root, 1, result);
+        }
+        return result;
+    }
+
+private:
+    static double area_of(const BoundingBox &box)
+    {
+        double ans = 1;
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            ans *= max(0.0, box.max_edges[axis] - box.min_edges[axis]);
+        }
+        return ans;
+    }
+
+    static double overlap_of(const BoundingBox &lhs, const BoundingBox &rhs)
+    {
+        double ans = 1;
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            double lo = max(lhs.min_edges[axis], rhs.min_edges[axis]);
+            double hi = min(lhs.max_edges[axis], rhs.max_edges[axis]);
+            if (hi <= lo)
+                return 0;
+            ans *= hi - lo;
+        }
+        return ans;
+    }
+
+    // Points have no volume, so point leaves never overlap.
+    static double overlap_of(const Point &, const Point &) { return 0; }
+
+    static size_t heap_bytes(const BoundingBox &box)
+    {
+        return (box.min_edges.capacity() + box.max_edges.capacity()) * sizeof(double);
+    }
+    static size_t heap_bytes(const Point &) { return 0; }
+
+    template <typename Child>
+    static double pairwise_overlap(const Node *node)
+    {
+        double total = 0;
+        for (size_t i = 0; i < node->items.size(); i++)
+        {
+            for (size_t j = i + 1; j < node->items.size(); j++)
+            {
+                total += overlap_of(static_cast<const Child *>(node->items[i])->box,
+                                    static_cast<const Child *>(node->items[j])->box);
+            }
+        }
+        return total;
+    }
+
+    void collect_stats(const Node *node, size_t depth, TreeStats &result) const
+    {
+        result.height = max(result.height, depth);
+        result.nodes++;
+        result.coverage += area_of(node->box);
+        for_each_child(const_cast<Node *>(node), [&result](auto *child)
+                       { result.child_box_bytes += sizeof(child->box) + heap_bytes(child->box); });
+        if (node->hasleaves)
+        {
+            result.total_overlap += pairwise_overlap<Leaf>(node);
+            result.leaf_nodes++;
+            result.leaves += node->items.size();
+            for (size_t i = 0; i < node->items.size(); i++)
+            {
+                const Leaf *leaf = static_cast<const Leaf *>(node->items[i]);
+                result.values += leaf->count();
+                result.leaf_bytes += sizeof(Leaf) + heap_bytes(leaf->box) +
+                                     leaf->bucket.capacity() * sizeof(LeafType);
             }
+            return;
+        }
+        result.total_overlap += pairwise_overlap<Node>(node);
+        for (size_t i = 0; i < node->items.size(); i++)
+        {
+            collect_stats(static_cast<const Node *>(node->items[i]), depth + 1, result);
         }
     }
 
@@ -1140,6 +3679,40 @@ public:
     almacenados en el árbol. Inicializada en 0 para indicar
     que el árbol está vacío al inicio.
 
+    - `bool bucket_duplicates{false};`: Si está activo, insert() agrupa
+    en una sola hoja los valores que comparten exactamente la misma caja.
+    Cuesta una búsqueda de la caja (find_equal_leaf()) en cada
+    inserción, así que está apagado por defecto y cada programa lo
+    activa si sus datos repiten cajas.
+
+    - `double reinsert_fraction{0.3}`: Fracción de los hijos de un nodo
+    desbordado que forced_reinsert() vuelve a insertar (se acota a
+    [0, 0.5]). Con 0 los desbordes se resuelven siempre dividiendo.
+
+    - `size_t version_{0};`: Contador de modificaciones del árbol.
+    Cada inserción o eliminación lo incrementa; los cursores lo usan
+    para detectar que un token de paginación quedó obsoleto.
+
+    - `node_arena` y `leaf_arena`: bloques contiguos creados por
+    relayout(); vacíos hasta la primera reorganización.
+
+    - `query_pool` y `parallel_query_threshold`: grupo de hilos de las
+    búsquedas paralelas (ver set_query_threads()) y cantidad de nodos
+    visitados a partir de la cual una búsqueda se reparte entre ellos.
+
+    - `dirty_nodes`, `next_page`, `pages_path`, `page_bytes` y
+    `live_page_bytes`: estado de los checkpoints incrementales (ver
+    checkpoint_pages()).
+
+    - `key_of` y `key_index`: función de clave y tabla de clave a hoja
+    del índice por clave (ver enable_key_index()); vacías si no se usa.
+
+    - `planner`, `histogram_cells`, `scan_axis_cost` y `selectivity`:
+    estado del planificador de búsquedas (ver enable_planner());
+    `scan_lo`, `scan_hi`, `scan_leaves` y `scan_version_` son el
+    arreglo compacto de find_objects_scan() y la versión del árbol
+    que copia.
+
     Estas variables son fundamentales para el funcionamiento y
     seguimiento de la estructura del árbol R*-Tree, desde
     mantener el conteo de elementos hasta el seguimiento de
@@ -1150,4 +3723,25 @@ public:
         used_deeps; //<boundaries used during the current insertion
     Node *tree_root{nullptr};
     size_t size_{0}; //<number of leaves
+    size_t version_{0}; //<modification counter checked by cursors
+    bool bucket_duplicates{false}; //<group values with identical boxes in one leaf
+    double reinsert_fraction{0.3}; //<share of an overflowing node's children reinserted
+    vector<Node> node_arena; //<nodes copied by relayout(), in preorder
+    vector<Leaf> leaf_arena; //<leaves copied by relayout()
+    unique_ptr<WorkStealingPool> query_pool; //<null: queries run sequentially
+    unordered_set<Node *> dirty_nodes; //<nodes with a page whose children changed
+    uint32_t next_page{1};             //<next page number in the page file
+    string pages_path;                 //<page file of the last checkpoint_pages()
+    unordered_map<uint32_t, uint64_t> page_bytes; //<bytes of the live version of each page
+    uint64_t live_page_bytes{0};
+    size_t parallel_query_threshold{256}; //<visited nodes after which a query goes parallel
+    function<Handle(const LeafType &)> key_of; //<empty: no key index
+    unordered_map<Handle, Leaf *> key_index;   //<key of each value -> leaf holding it
+    bool planner{false};          //<area searches choose between the tree and a scan
+    size_t histogram_cells{4096}; //<cell budget of the selectivity histogram
+    double scan_axis_cost{0.15};  //<one axis of one scanned leaf, in child box tests
+    SelectivityStats selectivity; //<statistics of the last analyze()
+    vector<double> scan_lo, scan_hi; //<leaf edges, axis by axis (scan_hi empty for points)
+    vector<Leaf *> scan_leaves;      //<leaf of each scanned row
+    size_t scan_version_{numeric_limits<size_t>::max()}; //<version_ the scan rows copy
 };
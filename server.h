@@ -0,0 +1,354 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+/*
+QueryServer atiende consultas sobre un árbol que queda cargado en
+memoria, con un protocolo de texto de una orden por línea. Los valores
+van en las unidades originales de los registros y el servidor los
+lleva al espacio del índice con el FeatureNormalizer usado en la carga;
+`*` en un rango significa sin límite. D es la cantidad de
+características.
+
+    range lo_1 .. lo_D hi_1 .. hi_D   ->  ok n r_1 .. r_n
+    count lo_1 .. lo_D hi_1 .. hi_D   ->  ok n
+    knn k x_1 .. x_D                  ->  ok n d_1 r_1 .. d_n r_n
+    within radio x_1 .. x_D           ->  ok n d_1 r_1 .. d_n r_n
+    insert x_1 .. x_D                 ->  ok size
+    delete lo_1 .. lo_D hi_1 .. hi_D  ->  ok eliminados
+    size                              ->  ok size
+    quit                              ->  ok bye
+
+Cada registro r_i sale como sus D valores separados por comas y d_i
+es la distancia en el espacio normalizado; knn y within los dan del
+más cercano al más lejano. Un error responde
+`err motivo` y no corta la conexión. Las normalizaciones no se
+recalculan con las inserciones.
+
+Las órdenes se pueden enviar en tubería (pipelining): el cliente
+escribe miles de líneas sin esperar, el servidor responde en el mismo
+orden y junta las respuestas en un búfer que envía de una vez cuando
+terminó de procesar lo que ya había llegado (ver serve_stream() y
+serve_unix_socket()).
+*/
+template <typename Tree, typename Normalizer, typename Record>
+class QueryServer
+{
+public:
+    using Features = typename Normalizer::Features;
+    static constexpr size_t dimensions = tuple_size<Features>::value;
+
+    QueryServer(Tree &tree, const Normalizer &normalizer,
+                function<Features(const Record &)> features_of,
+                function<Record(const Features &)> record_of)
+        : tree(tree), normalizer(normalizer), features_of(move(features_of)),
+          record_of(move(record_of))
+    {
+    }
+
+    bool stopped() const { return stop; }
+
+    // Runs one command line and appends its response line to `out`.
+    void execute(string_view line, string &out)
+    {
+        executed++;
+        Tokens tokens{line};
+        string_view command = tokens.next();
+        try
+        {
+            if (command == "range" || command == "count" || command == "delete")
+            {
+                Features lo = tokens.features(true, -numeric_limits<double>::infinity());
+                Features hi = tokens.features(true, numeric_limits<double>::infinity());
+                tokens.finish();
+                auto area = normalizer.query_box(lo, hi);
+                if (command == "delete")
+                {
+                    size_t before = tree.size_;
+                    tree.delete_objects_in_area(area);
+                    reply(out, before - tree.size_);
+                }
+                else
+                {
+                    auto results = tree.find_objects_in_area(area);
+                    out += "ok ";
+                    append_number(out, double(results.size()));
+                    if (command == "range")
+                    {
+                        for (auto &leaf : results)
+                            append_record(out, leaf.get_value());
+                    }
+                    out += '\n';
+                }
+            }
+            else if (command == "knn" || command == "within")
+            {
+                double k = tokens.number(false, 0);
+                Features at = tokens.features(false, 0);
+                tokens.finish();
+                auto point = normalizer.point(at);
+                vector<typename Tree::LeafWithConstBox> results;
+                if (command == "within")
+                {
+                    if (!(k >= 0))
+                        throw invalid_argument("the radius must be non-negative");
+                    results = tree.find_objects_within_distance(point, k, Tree::unit_weights(), true);
+                }
+                else
+                {
+                    if (k < 0 || k != floor(k))
+                        throw invalid_argument("k must be a non-negative integer");
+                    results = tree.find_nearest(point, size_t(min(k, double(tree.size_))));
+                }
+                out += "ok ";
+                append_number(out, double(results.size()));
+                for (auto &leaf : results)
+                {
+                    out += ' ';
+                    append_number(out, sqrt(distance(leaf.get_box(), point)));
+                    append_record(out, leaf.get_value());
+                }
+                out += '\n';
+            }
+            else if (command == "insert")
+            {
+                Features values = tokens.features(false, 0);
+                tokens.finish();
+                if constexpr (point_leaves)
+                    tree.insert(record_of(values), normalizer.point(values));
+                else
+                    tree.insert(record_of(values), normalizer.point_box(values));
+                reply(out, tree.size_);
+            }
+            else if (command == "size")
+            {
+                tokens.finish();
+                reply(out, tree.size_);
+            }
+            else if (command == "quit")
+            {
+                stop = true;
+                out += "ok bye\n";
+            }
+            else if (command.empty())
+            {
+                executed--; // blank line
+            }
+            else
+            {
+                throw invalid_argument("unknown command");
+            }
+        }
+        catch (const invalid_argument &error)
+        {
+            out += "err ";
+            out += error.what();
+            out += '\n';
+        }
+    }
+
+    size_t executed{0}; //<commands run
+
+private:
+    static constexpr bool point_leaves =
+        is_same<typename Tree::LeafGeometry, typename Tree::Point>::value;
+
+    // Whitespace tokenizer over the line; numbers are parsed in place.
+    struct Tokens
+    {
+        string_view line;
+        size_t pos{0};
+
+        string_view next()
+        {
+            while (pos < line.size() && isspace(static_cast<unsigned char>(line[pos])))
+                pos++;
+            size_t start = pos;
+            while (pos < line.size() && !isspace(static_cast<unsigned char>(line[pos])))
+                pos++;
+            return line.substr(start, pos - start);
+        }
+
+        double number(bool wildcard, double unbounded)
+        {
+            string_view token = next();
+            if (token.empty())
+                throw invalid_argument("missing value");
+            if (wildcard && token == "*")
+                return unbounded;
+            double value;
+            auto result = from_chars(token.data(), token.data() + token.size(), value);
+            if (result.ec != errc() || result.ptr != token.data() + token.size())
+                throw invalid_argument("bad number");
+            return value;
+        }
+
+        Features features(bool wildcard, double unbounded)
+        {
+            Features values;
+            for (double &value : values)
+                value = number(wildcard, unbounded);
+            return values;
+        }
+
+        void finish()
+        {
+            if (!next().empty())
+                throw invalid_argument("too many values");
+        }
+    };
+
+    static double distance(const typename Tree::Point &leaf, const typename Tree::Point &point)
+    {
+        double sum = 0;
+        for (size_t axis = 0; axis < dimensions; axis++)
+            sum += (leaf.coords[axis] - point.coords[axis]) * (leaf.coords[axis] - point.coords[axis]);
+        return sum;
+    }
+
+    template <typename Box>
+    static double distance(const Box &leaf, const typename Tree::Point &point)
+    {
+        double sum = 0;
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            double value = point.coords[axis];
+            double d = max({leaf.min_edges[axis] - value, value - leaf.max_edges[axis], 0.0});
+            sum += d * d;
+        }
+        return sum;
+    }
+
+    static void append_number(string &out, double value)
+    {
+        char buffer[32];
+        auto result = to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, result.ptr);
+    }
+
+    void append_record(string &out, const Record &record) const
+    {
+        Features values = features_of(record);
+        for (size_t i = 0; i < dimensions; i++)
+        {
+            out += i == 0 ? ' ' : ',';
+            append_number(out, values[i]);
+        }
+    }
+
+    static void reply(string &out, size_t value)
+    {
+        out += "ok ";
+        append_number(out, double(value));
+        out += '\n';
+    }
+
+    Tree &tree;
+    const Normalizer &normalizer;
+    function<Features(const Record &)> features_of;
+    function<Record(const Features &)> record_of;
+    bool stop{false};
+};
+
+/*
+serve_stream() atiende órdenes desde un flujo (la entrada estándar) y
+escribe las respuestas en otro. Las respuestas se acumulan mientras
+quede entrada ya leída en el búfer del flujo y se envían juntas cuando
+se vacía o pasan de 64 KiB. Con cin conviene llamar antes a
+ios::sync_with_stdio(false) para que cin tenga su propio búfer.
+*/
+template <typename Server>
+void serve_stream(Server &server, istream &in, ostream &out)
+{
+    string line, responses;
+    while (!server.stopped() && getline(in, line))
+    {
+        server.execute(line, responses);
+        if (responses.size() > (1 << 16) || in.rdbuf()->in_avail() <= 0)
+        {
+            out.write(responses.data(), responses.size());
+            out.flush();
+            responses.clear();
+        }
+    }
+    out.write(responses.data(), responses.size());
+    out.flush();
+}
+
+#ifndef _WIN32
+/*
+serve_unix_socket() escucha en un socket de dominio Unix en `path` y
+atiende a un cliente por vez hasta recibir quit. Lee de a bloques de
+64 KiB, ejecuta todas las líneas completas del bloque y responde con
+una sola escritura por bloque.
+*/
+template <typename Server>
+void serve_unix_socket(Server &server, const string &path)
+{
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        throw invalid_argument("serve_unix_socket: path too long");
+    }
+    address.sun_family = AF_UNIX;
+    path.copy(address.sun_path, path.size());
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path.c_str());
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(listener, 8) != 0)
+    {
+        if (listener >= 0)
+            close(listener);
+        throw invalid_argument("serve_unix_socket: cannot listen on " + path);
+    }
+    vector<char> buffer(1 << 16);
+    while (!server.stopped())
+    {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0)
+            break;
+        string pending, responses;
+        ssize_t received;
+        while (!server.stopped() && (received = read(client, buffer.data(), buffer.size())) > 0)
+        {
+            pending.append(buffer.data(), size_t(received));
+            size_t start = 0;
+            for (size_t end; !server.stopped() && (end = pending.find('\n', start)) != string::npos; start = end + 1)
+            {
+                server.execute(string_view(pending).substr(start, end - start), responses);
+            }
+            pending.erase(0, start);
+            for (size_t sent = 0; sent < responses.size();)
+            {
+                ssize_t written = write(client, responses.data() + sent, responses.size() - sent);
+                if (written <= 0)
+                    break;
+                sent += size_t(written);
+            }
+            responses.clear();
+        }
+        close(client);
+    }
+    close(listener);
+    unlink(path.c_str());
+}
+#endif
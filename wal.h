@@ -0,0 +1,312 @@
+#pragma once
+#include "boundingbox.h"
+#include "pagefile.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+/*
+WriteAheadLog hace durables las modificaciones de un RStarTree entre
+checkpoints. Junto al árbol viven dos archivos:
+
+* la instantánea (`snapshot_path`): el archivo de páginas de
+RStarTree::checkpoint_pages(), con la generación como etiqueta;
+* el log (`log_path`): un encabezado con la generación y, a
+continuación, un registro binario por operación: un byte de tipo
+(inserción o eliminación), la geometría como doubles, el valor
+(LeafType byte a byte) en las inserciones, y una suma de verificación
+FNV-1a de 32 bits del registro.
+
+insert() y delete_objects_in_area() aplican la operación al árbol y
+agregan su registro a un búfer. Los registros se escriben y se fuerzan
+al disco (fsync) en grupo con commit(), que se llama solo cada
+`group_size` operaciones; una operación es durable cuando terminó el
+commit() que la incluye. El destructor hace el último commit().
+
+open() recupera el estado al arrancar: carga la instantánea, si
+existe, y vuelve a aplicar los registros del log en orden. Un
+registro incompleto o con suma incorrecta al final (una escritura
+cortada por una caída) termina la lectura y se recorta del archivo.
+
+checkpoint() escribe en la instantánea solo los nodos que cambiaron
+desde el checkpoint anterior, con la generación siguiente, y recién
+entonces vacía el log. El log solo se aplica si su generación no es menor que
+la de la instantánea, así una caída entre los dos pasos no repite
+operaciones que ya están en la instantánea.
+*/
+template <typename Tree>
+class WriteAheadLog
+{
+public:
+    using Value = typename Tree::Value;
+    using Geometry = typename Tree::LeafGeometry;
+    using Area = typename Tree::Area;
+
+    WriteAheadLog(Tree &tree, string snapshot_path, string log_path, size_t group_size = 64)
+        : tree(tree), snapshot_path(move(snapshot_path)), log_path(move(log_path)),
+          group_size(max<size_t>(group_size, 1))
+    {
+        static_assert(is_trivially_copyable<Value>::value,
+                      "WriteAheadLog: the tree values must be trivially copyable");
+    }
+
+    ~WriteAheadLog()
+    {
+        if (log)
+        {
+            try
+            {
+                commit();
+            }
+            catch (const invalid_argument &)
+            { // the pending records are lost, as in a crash
+            }
+            fclose(log);
+        }
+    }
+
+    WriteAheadLog(const WriteAheadLog &) = delete;
+    WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+    // Loads the snapshot, replays the log and opens it for appending.
+    void open()
+    {
+        generation = 0;
+        if (filesystem::exists(snapshot_path))
+        {
+            generation = tree.load_pages(snapshot_path);
+        }
+        replayed = 0;
+        bool reset = true;
+        if (FILE *in = fopen(log_path.c_str(), "rb"))
+        {
+            uint64_t header[2];
+            size_t valid = 0;
+            if (fread(header, sizeof(header), 1, in) == 1 && header[0] == log_magic &&
+                header[1] >= generation)
+            {
+                valid = replay(in);
+                reset = false;
+            }
+            fclose(in);
+            if (!reset)
+            {
+                filesystem::resize_file(log_path, valid);
+            }
+        }
+        if (reset)
+        {
+            start_log();
+        }
+        else
+        {
+            log = fopen(log_path.c_str(), "ab");
+        }
+        if (!log)
+        {
+            throw invalid_argument("WriteAheadLog: cannot open " + log_path);
+        }
+    }
+
+    void insert(const Value &value, const Geometry &geometry)
+    {
+        size_t start = begin_record(insert_record);
+        put_geometry(geometry);
+        put(&value, sizeof(value));
+        end_record(start);
+        tree.insert(value, geometry);
+    }
+
+    void delete_objects_in_area(const Area &area)
+    {
+        size_t start = begin_record(delete_record);
+        put_geometry(area);
+        end_record(start);
+        tree.delete_objects_in_area(area);
+    }
+
+    // Writes the pending records and waits until they reach the disk.
+    void commit()
+    {
+        if (pending_records == 0)
+            return;
+        if (fwrite(pending.data(), 1, pending.size(), log) != pending.size())
+        {
+            throw invalid_argument("WriteAheadLog: cannot write " + log_path);
+        }
+        sync_to_disk(log);
+        pending.clear();
+        pending_records = 0;
+        commits++;
+    }
+
+    void checkpoint()
+    {
+        commit();
+        tree.checkpoint_pages(snapshot_path, generation + 1);
+        generation++;
+        fclose(log);
+        start_log();
+        checkpoints++;
+    }
+
+    size_t logged{0};      //<records appended since open()
+    size_t commits{0};     //<group commits (one fsync each)
+    size_t replayed{0};    //<records applied by the last open()
+    size_t checkpoints{0}; //<checkpoints written
+
+private:
+    enum : uint8_t
+    {
+        insert_record = 1,
+        delete_record = 2
+    };
+    static constexpr uint64_t log_magic = 0x31474f4c52524157; // "WARRLOG1"
+
+    void start_log()
+    {
+        log = fopen(log_path.c_str(), "wb");
+        if (!log)
+        {
+            throw invalid_argument("WriteAheadLog: cannot open " + log_path);
+        }
+        uint64_t header[2] = {log_magic, generation};
+        fwrite(header, sizeof(header), 1, log);
+        sync_to_disk(log);
+    }
+
+    void put(const void *data, size_t size)
+    {
+        const char *bytes = static_cast<const char *>(data);
+        pending.insert(pending.end(), bytes, bytes + size);
+    }
+
+    template <size_t dimensions, typename cost_type>
+    void put_geometry(const RStarBoundingBox<dimensions, cost_type> &box)
+    {
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            put(&box.min_edges[axis], sizeof(double));
+            put(&box.max_edges[axis], sizeof(double));
+        }
+    }
+
+    template <size_t dimensions, typename cost_type>
+    void put_geometry(const RStarPoint<dimensions, cost_type> &point)
+    {
+        put(point.coords.data(), sizeof(point.coords));
+    }
+
+    template <size_t dimensions, typename cost_type>
+    static void get_geometry(const char *&data, RStarBoundingBox<dimensions, cost_type> &box)
+    {
+        for (size_t axis = 0; axis < dimensions; axis++)
+        {
+            memcpy(&box.min_edges[axis], data, sizeof(double));
+            memcpy(&box.max_edges[axis], data + sizeof(double), sizeof(double));
+            data += 2 * sizeof(double);
+        }
+    }
+
+    template <size_t dimensions, typename cost_type>
+    static void get_geometry(const char *&data, RStarPoint<dimensions, cost_type> &point)
+    {
+        memcpy(point.coords.data(), data, sizeof(point.coords));
+        data += sizeof(point.coords);
+    }
+
+    template <size_t dimensions, typename cost_type>
+    static size_t geometry_size(const RStarBoundingBox<dimensions, cost_type> &)
+    {
+        return 2 * dimensions * sizeof(double);
+    }
+
+    template <size_t dimensions, typename cost_type>
+    static size_t geometry_size(const RStarPoint<dimensions, cost_type> &point)
+    {
+        return sizeof(point.coords);
+    }
+
+    size_t begin_record(uint8_t type)
+    {
+        if (!log)
+        {
+            throw invalid_argument("WriteAheadLog: open() was not called");
+        }
+        size_t start = pending.size();
+        put(&type, 1);
+        return start;
+    }
+
+    void end_record(size_t start)
+    {
+        uint32_t sum = fnv1a(pending.data() + start, pending.size() - start);
+        put(&sum, sizeof(sum));
+        pending_records++;
+        logged++;
+        if (pending_records >= group_size)
+        {
+            commit();
+        }
+    }
+
+    // Applies every complete record and returns the offset after the last one.
+    size_t replay(FILE *in)
+    {
+        const size_t area_bytes = geometry_size(Area());
+        const size_t geometry_bytes = geometry_size(Geometry());
+        size_t valid = 2 * sizeof(uint64_t);
+        vector<char> record;
+        uint8_t type;
+        while (fread(&type, 1, 1, in) == 1)
+        {
+            size_t payload = type == insert_record   ? geometry_bytes + sizeof(Value)
+                             : type == delete_record ? area_bytes
+                                                     : 0;
+            if (payload == 0)
+                break;
+            record.resize(1 + payload + sizeof(uint32_t));
+            record[0] = char(type);
+            if (fread(record.data() + 1, record.size() - 1, 1, in) != 1)
+                break;
+            uint32_t sum;
+            memcpy(&sum, record.data() + 1 + payload, sizeof(sum));
+            if (sum != fnv1a(record.data(), 1 + payload))
+                break;
+            const char *data = record.data() + 1;
+            if (type == insert_record)
+            {
+                Geometry geometry;
+                Value value;
+                get_geometry(data, geometry);
+                memcpy(&value, data, sizeof(Value));
+                tree.insert(value, geometry);
+            }
+            else
+            {
+                Area area;
+                get_geometry(data, area);
+                tree.delete_objects_in_area(area);
+            }
+            valid += record.size();
+            replayed++;
+        }
+        return valid;
+    }
+
+    Tree &tree;
+    string snapshot_path, log_path;
+    size_t group_size;
+    uint64_t generation{0};
+    FILE *log{nullptr};
+    vector<char> pending;
+    size_t pending_records{0};
+};